@@ -0,0 +1,178 @@
+#include "AllocStats.h"
+#include <stdio.h> // snprintf()
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+namespace yadsl
+{
+
+#if YADSL_ALLOC_STATS
+
+AllocStats::AllocStats(const char* kind, size_t blockBytes) :
+    kind_(kind), name_(), blockBytes_(blockBytes), liveNum_(0), peakLiveNum_(0), allocNum_(0), freeNum_(0),
+    cacheHitNum_(0), fallbackNum_(0), reservedBytes_(0), registryIndex_(0) {
+    AllocStatsRegistry::Instance().Register(this);
+}
+
+AllocStats::~AllocStats() {
+    AllocStatsRegistry::Instance().Unregister(this);
+}
+
+void AllocStats::Read(Snapshot& s) const {
+    s.kind_ = kind_;
+    s.name_ = name_;
+    s.liveNum_ = liveNum_.load(std::memory_order_relaxed);
+    s.peakLiveNum_ = peakLiveNum_.load(std::memory_order_relaxed);
+    s.allocNum_ = allocNum_.load(std::memory_order_relaxed);
+    s.freeNum_ = freeNum_.load(std::memory_order_relaxed);
+    s.cacheHitNum_ = cacheHitNum_.load(std::memory_order_relaxed);
+    s.fallbackNum_ = fallbackNum_.load(std::memory_order_relaxed);
+    s.reservedBytes_ = reservedBytes_.load(std::memory_order_relaxed);
+    s.usedBytes_ = s.liveNum_ * blockBytes_;
+}
+
+//-----------------------------------------------------------------------------
+
+namespace
+{
+
+// Дописать строку в кавычках JSON
+void AppendJsonString(std::string& out, const std::string& s) {
+    out += '"';
+    for (size_t i = 0; i < s.size(); ++i) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (int)c);
+            out += buf;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void AppendUint(std::string& out, uint64_t n) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)n);
+    out += buf;
+}
+
+} // end of anonymous namespace
+
+#endif
+
+AllocStatsRegistry::AllocStatsRegistry() {
+}
+
+AllocStatsRegistry& AllocStatsRegistry::Instance() {
+    static AllocStatsRegistry* instance = new AllocStatsRegistry(); // не уничтожается намеренно
+    return *instance;
+}
+
+void AllocStatsRegistry::Register(AllocStats* stats) {
+#if YADSL_ALLOC_STATS
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats->registryIndex_ = stats_.size();
+    stats_.push_back(stats);
+#else
+    YADSL_UNUSED_FUNC_PARAM(stats);
+#endif
+}
+
+void AllocStatsRegistry::Unregister(AllocStats* stats) {
+#if YADSL_ALLOC_STATS
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t i = stats->registryIndex_;
+#ifdef YADSL_USE_WXDEBUG
+    wxASSERT(i < stats_.size() && stats_[i] == stats);
+#endif
+    stats_[i] = stats_.back();
+    stats_[i]->registryIndex_ = i;
+    stats_.pop_back();
+#else
+    YADSL_UNUSED_FUNC_PARAM(stats);
+#endif
+}
+
+size_t AllocStatsRegistry::Num() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_.size();
+}
+
+void AllocStatsRegistry::DumpText(std::string& out) const {
+#if YADSL_ALLOC_STATS
+    std::lock_guard<std::mutex> lock(mutex_);
+    AllocStats::Snapshot s;
+    for (size_t i = 0; i < stats_.size(); ++i) {
+        stats_[i]->Read(s);
+        out += s.kind_;
+        if (!s.name_.empty()) {
+            out += " \"";
+            out += s.name_;
+            out += '"';
+        }
+        out += ": live ";
+        AppendUint(out, s.liveNum_);
+        out += ", peak ";
+        AppendUint(out, s.peakLiveNum_);
+        out += ", allocs ";
+        AppendUint(out, s.allocNum_);
+        out += ", frees ";
+        AppendUint(out, s.freeNum_);
+        out += ", cache hits ";
+        AppendUint(out, s.cacheHitNum_);
+        out += ", fallbacks ";
+        AppendUint(out, s.fallbackNum_);
+        out += ", bytes reserved ";
+        AppendUint(out, s.reservedBytes_);
+        out += ", used ";
+        AppendUint(out, s.usedBytes_);
+        out += '\n';
+    }
+#else
+    YADSL_UNUSED_FUNC_PARAM(out);
+#endif
+}
+
+void AllocStatsRegistry::DumpJson(std::string& out) const {
+    out += '[';
+#if YADSL_ALLOC_STATS
+    std::lock_guard<std::mutex> lock(mutex_);
+    AllocStats::Snapshot s;
+    for (size_t i = 0; i < stats_.size(); ++i) {
+        stats_[i]->Read(s);
+        if (i != 0) out += ',';
+        out += "{\"kind\":";
+        AppendJsonString(out, s.kind_);
+        out += ",\"name\":";
+        AppendJsonString(out, s.name_);
+        out += ",\"live\":";
+        AppendUint(out, s.liveNum_);
+        out += ",\"peak\":";
+        AppendUint(out, s.peakLiveNum_);
+        out += ",\"allocs\":";
+        AppendUint(out, s.allocNum_);
+        out += ",\"frees\":";
+        AppendUint(out, s.freeNum_);
+        out += ",\"cacheHits\":";
+        AppendUint(out, s.cacheHitNum_);
+        out += ",\"fallbacks\":";
+        AppendUint(out, s.fallbackNum_);
+        out += ",\"reservedBytes\":";
+        AppendUint(out, s.reservedBytes_);
+        out += ",\"usedBytes\":";
+        AppendUint(out, s.usedBytes_);
+        out += '}';
+    }
+#endif
+    out += ']';
+}
+
+} // end of yadsl
@@ -0,0 +1,164 @@
+#ifndef YADSL_ALLOCSTATS_H
+#define YADSL_ALLOCSTATS_H
+
+/** @file AllocStats.h.
+
+Назначение: счетчики пулов и аллокаторов и реестр, через который их можно выгрузить текстом или в JSON.
+*/
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "BaseTypes.h"
+#include "Utils.h"
+
+#ifndef YADSL_ALLOC_STATS
+#define YADSL_ALLOC_STATS 1 // вкл(1)/выкл(0) счетчиков пулов и аллокаторов
+#endif
+
+namespace yadsl
+{
+
+/** @brief Счетчики одного пула или аллокатора: число живых объектов и его пик, число выделений и освобождений,
+попадания в кэш свободных блоков и обращения за памятью к куче (арене), зарезервированные и занятые байты.
+
+Счетчик принадлежит пулу, в который встроен, и изменяется только потоком, работающим с пулом (пулы библиотеки
+не потокобезопасны, разделяемые пулы меняют свои счетчики под мьютексом). Поэтому увеличение счетчика -
+это relaxed-чтение и relaxed-запись атомарного слова без read-modify-write: на x86 это обычные mov и add.
+Атомарность нужна только затем, чтобы Dump() из другого потока читал целые, пусть и немного устаревшие, значения.
+
+При YADSL_ALLOC_STATS = 0 все методы пустые, счетчики не хранятся, пулы в реестре не регистрируются.
+
+Экземпляр регистрируется в AllocStatsRegistry при создании и снимается с регистрации при уничтожении.
+@code
+ClassInstanceMemBlockPool<Particle> pool;
+pool.Stats().SetName("particles");
+//...
+std::string json;
+AllocStatsRegistry::Instance().DumpJson(json);
+@endcode
+*/
+class AllocStats {
+public:
+    /// Значения счетчиков на момент чтения
+    struct Snapshot {
+        std::string kind_;          ///< вид пула (имя класса)
+        std::string name_;          ///< имя экземпляра, заданное SetName()
+        uint64_t liveNum_;          ///< выделено и не освобождено объектов
+        uint64_t peakLiveNum_;      ///< наибольшее значение liveNum_
+        uint64_t allocNum_;         ///< всего выделений
+        uint64_t freeNum_;          ///< всего освобождений
+        uint64_t cacheHitNum_;      ///< выделений из свободных блоков пула
+        uint64_t fallbackNum_;      ///< обращений за памятью к куче или арене
+        uint64_t reservedBytes_;    ///< байт памяти, полученных пулом от кучи или арены
+        uint64_t usedBytes_;        ///< байт в выделенных блоках
+    };
+
+private:
+#if YADSL_ALLOC_STATS
+    typedef std::atomic<uint64_t> Counter;
+
+    static void Add(Counter& c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    const char* kind_;
+    std::string name_;          // меняется только до начала выгрузок (@see SetName())
+    size_t blockBytes_;         // размер блока, для подсчета занятых байт
+    Counter liveNum_;
+    Counter peakLiveNum_;
+    Counter allocNum_;
+    Counter freeNum_;
+    Counter cacheHitNum_;
+    Counter fallbackNum_;
+    Counter reservedBytes_;
+    size_t registryIndex_;      // позиция в реестре, снятие с регистрации - за O(1) (@see AllocStatsRegistry)
+
+    friend class AllocStatsRegistry;
+#endif
+
+    AllocStats(const AllocStats&);
+    AllocStats& operator=(const AllocStats&);
+
+public:
+#if YADSL_ALLOC_STATS
+    /** @brief Конструктор, регистрирует счетчики в AllocStatsRegistry.
+    @param kind вид пула, строка должна жить все время жизни счетчиков (обычно строковый литерал).
+    @param blockBytes размер блока, выдаваемого пулом.
+    */
+    AllocStats(const char* kind, size_t blockBytes);
+    ~AllocStats();
+
+    /// Учесть выделение блока; fCacheHit - блок взят из свободных блоков пула без обращения к куче
+    void OnAlloc(bool fCacheHit) {
+        Add(allocNum_, 1);
+        Add(fCacheHit ? cacheHitNum_ : fallbackNum_, 1);
+        uint64_t live = liveNum_.load(std::memory_order_relaxed) + 1;
+        liveNum_.store(live, std::memory_order_relaxed);
+        if (live > peakLiveNum_.load(std::memory_order_relaxed)) {
+            peakLiveNum_.store(live, std::memory_order_relaxed);
+        }
+    }
+    /// Учесть освобождение блока
+    void OnFree() {
+        Add(freeNum_, 1);
+        liveNum_.store(liveNum_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+    /// Учесть память, полученную от кучи или арены
+    void OnReserve(size_t bytes) { Add(reservedBytes_, bytes); }
+    /// Учесть память, возвращенную в кучу или арену
+    void OnRelease(size_t bytes) { Add(reservedBytes_, uint64_t(0) - bytes); }
+
+    /// Задать имя экземпляра для выгрузки. Вызывается владельцем до того, как счетчики начнут выгружаться.
+    void SetName(const char* name) { name_ = name; }
+    /// Прочитать счетчики
+    void Read(Snapshot& s) const;
+#else
+    AllocStats(const char* kind, size_t blockBytes) { YADSL_UNUSED_FUNC_PARAM(kind); YADSL_UNUSED_FUNC_PARAM(blockBytes); }
+    void OnAlloc(bool fCacheHit) { YADSL_UNUSED_FUNC_PARAM(fCacheHit); }
+    void OnFree() {}
+    void OnReserve(size_t bytes) { YADSL_UNUSED_FUNC_PARAM(bytes); }
+    void OnRelease(size_t bytes) { YADSL_UNUSED_FUNC_PARAM(bytes); }
+    void SetName(const char* name) { YADSL_UNUSED_FUNC_PARAM(name); }
+#endif
+};
+
+/** @brief Реестр счетчиков всех живых пулов и аллокаторов.
+Регистрация и выгрузка идут под мьютексом реестра, на пути выделения и освобождения реестр не участвует.
+Счетчики помнят свою позицию в реестре, поэтому регистрация и снятие с нее выполняются за O(1)
+(на место снятого встают последние счетчики реестра). Реестр создается при первом обращении и не уничтожается, поэтому в нем можно сниматься с регистрации
+из деструкторов статических объектов.
+*/
+class AllocStatsRegistry {
+private:
+    mutable std::mutex mutex_;
+    std::vector<AllocStats*> stats_;
+
+    AllocStatsRegistry();
+    AllocStatsRegistry(const AllocStatsRegistry&);
+    AllocStatsRegistry& operator=(const AllocStatsRegistry&);
+
+public:
+    static AllocStatsRegistry& Instance();
+
+    void Register(AllocStats* stats);
+    void Unregister(AllocStats* stats);
+
+    /// Число зарегистрированных счетчиков
+    size_t Num() const;
+
+    /** @brief Выгрузить счетчики текстом: по строке на пул.
+    @param out строка, к которой дописывается выгрузка.
+    */
+    void DumpText(std::string& out) const;
+
+    /** @brief Выгрузить счетчики массивом объектов JSON.
+    @param out строка, к которой дописывается выгрузка.
+    */
+    void DumpJson(std::string& out) const;
+};
+
+} // end of yadsl
+
+#endif // YADSL_ALLOCSTATS_H
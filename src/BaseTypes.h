@@ -30,6 +30,7 @@ namespace yadsl
 typedef uint32_t uint;
 enum { /** @brief Недопустмое значение идентификатора. */ kNoId = 0xffffffff  };
 enum { /** @brief Недопустимое значение индекса. */ kNoIndex = 0xffffffff };
+enum { /** @brief Параметр шаблона списков: элементы - POD, деструкторы не вызываются. */ kPOD_LIST = 1 };
 
 } // end of yadsl
 
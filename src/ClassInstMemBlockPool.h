@@ -1,23 +1,33 @@
 #ifndef YADSL_CLASSINSTMEMBLOCKPOOL_H_
 #define YADSL_CLASSINSTMEMBLOCKPOOL_H_
 
-
-#ifdef YADSL_USE_IDVALUEVECTOR_IN_CLASSINSTANCEMEMBLOCKPOOL
-#include "IdValueVector.h"
-#else
-#include <map>
-#include "BaseTypes.h"
-#endif
+#include <vector>
+#include <algorithm> // std::lower_bound()
+#include <new>
+#include <utility> // std::forward()
+#include <stddef.h> // offsetof()
+#include <string.h> // memset()
 
 #include <wx/wx.h>
-#include <wx/SharedPtr.h>
 
-#include "UniqIntGen.h"
+#include "BaseTypes.h"
+#include "Utils.h"
+#include "PageArena.h"
+#include "AllocStats.h"
 
 namespace yadsl
 {
 
 #define YADSL_TEST_CLASSINSTANCEMEMBLOCKPOOL 0
+
+/// Флаги размещения блоков пула ClassInstanceMemBlockPool
+enum {
+    kMemPool_CacheLinePadded = 1    ///< каждый блок занимает целое число строк кэша и начинается с границы строки
+};
+
+/// Размер строки кэша, по которому выравниваются блоки с флагом kMemPool_CacheLinePadded
+enum { kCacheLineSize = 64 };
+
 /** @brief Пул блоков памяти для размещения экземпляров заданного в шаблоне типа. Это не обязательно классы, тип хранимых данных может быть
 и структурой и даже встроенным типом. Однако не рекомендуется размещать в пуле встроенные типы и маленькие структуры из-за больших накладных
 расходов на память.
@@ -33,17 +43,15 @@ public:
     Person( const char* name, int age) : name_(name), age_(age) {}
 };
 ClassInstanceMemBlockPool<Person> personPool;
-void* mem = personPool.Alloc();
-new(mem) Person("James Cameron", 64);
-Person* director = (Person*)mem;
+Person* director = personPool.Construct("James Cameron", 64);
 printf("Person: %s %d years old\n",
        director->name_.c_str(),
        director->age_);
-personPool.Free(director);
+personPool.Destroy(director);
 
-mem = personPool.Alloc();
-new(mem) Person("Arnold Schwarzenegger", 71);
-Person* actor = (Person*)mem;
+void* mem = personPool.Alloc(); // или вручную: выделение, конструирование и пометка
+Person* actor = new(mem) Person("Arnold Schwarzenegger", 71);
+personPool.MarkAsConstructed(actor);
 printf("Person: %s %d years old\n",
        actor->name_.c_str(),
        actor->age_);
@@ -51,80 +59,271 @@ printf("Person: %s %d years old\n",
 printf("Person pool size: %d\n", personPool.AllBlockNum());
 @endcode
 
-###Сборка###
-Макрос YADSL_USE_IDVALUEVECTOR_IN_CLASSINSTANCEMEMBLOCKPOOL отвечает за реализацию на основе IdValueVector. Без установки
-этого макроса пул будет собран на основе std::map.
+###Слябы###
+Блоки выделяются из кучи не поштучно, а слябами - непрерывными массивами блоков (желаемый размер задается в конструкторе,
+например 64 или 4096). На сляб приходится один вызов кучи, соседние экземпляры лежат в памяти подряд, и при их обходе
+работает аппаратная предвыборка. Размер сляба в байтах округляется до степени двойки, сляб выравнивается по своему размеру,
+поэтому SlabSize() может оказаться больше заданного в конструкторе.
+Слябы очень больших пулов можно брать из арены страниц PageArena, в том числе на больших страницах, чтобы
+обход экземпляров меньше страдал от промахов TLB: арена передается в конструктор.
+
+###Свободные блоки###
+Свободные блоки связаны в односвязные списки, звенья которых хранятся в памяти самих блоков. Alloc() снимает блок
+с головы списка сляба (или берет следующий нетронутый блок сляба), Free() кладет блок в голову списка - по несколько
+инструкций без поиска и выделений памяти. Идентификатор блока нигде не хранится: BlockId() вычисляет его по адресу
+блока только тогда, когда он нужен вызывающему.
+
+###Возврат памяти###
+Свободные блоки каждого сляба связаны в собственный список, а пул ведет число выданных блоков в каждом слябе.
+Блоки выдаются из частично занятых слябов, поэтому опустевший сляб остается пустым и может быть возвращен в кучу
+целиком: явно вызовом Trim() или автоматически по порогам SetAutoTrim() с гистерезисом. Reserve() заранее выделяет
+слябы перед известным всплеском нагрузки, чтобы выделения в критичном по времени месте не обращались к куче.
+@code
+pool.SetAutoTrim(4, 1); // больше 4 пустых слябов - вернуть в кучу все, кроме одного
+pool.Reserve(10000);    // перед загрузкой уровня
+@endcode
+
+###Сконструированность###
+Construct() и Destroy() выделяют блок, конструируют в нем экземпляр и ведут метку сконструированности сами. Метки хранятся
+битовой картой в заголовке сляба, поэтому в сборке без YADSL_USE_WXDEBUG блок занимает ровно sizeof(T) с округлением
+до выравнивания. В отладочной сборке к блоку добавляется слово-метка fConstructed_ для поиска порчи памяти.
+
+###Выравнивание###
+Блоки выравниваются по alignof(T), поэтому в пуле можно размещать типы с членами SSE/AVX и alignas(64).
+С флагом kMemPool_CacheLinePadded в параметре Flags блок дополнительно выравнивается и дополняется до строки кэша:
+экземпляры, в которые пишут разные потоки, не делят строки кэша (нет ложного разделения) ценой памяти на маленьких типах.
+@code
+ClassInstanceMemBlockPool<PerThreadCounters, kMemPool_CacheLinePadded> countersPool;
+@endcode
 */
-template <typename T>
+template <typename T, int Flags = 0>
 class ClassInstanceMemBlockPool {
 private:
+    enum { kBlockAlign = (Flags & kMemPool_CacheLinePadded) && alignof(T) < kCacheLineSize ? size_t(kCacheLineSize) : alignof(T) };
+
     // Блок памяти
-    struct MemBlock {
-        uint8_t data_[sizeof(T)];   // непосредственно сам участок памяти
-        uint id_;                    // идентификатор блока памяти
+    struct alignas(kBlockAlign) MemBlock {
+        union {
+            alignas(T) uint8_t data_[sizeof(T)];   // непосредственно сам участок памяти
+            MemBlock* nextFree_;        // следующий свободный блок (пока блок свободен)
+        };
+#ifdef YADSL_USE_WXDEBUG
         int fConstructed_; // флагом конструированности взята замысловатая последовательность бит (надежнее чем просто true), 0xA965
-
-        MemBlock(uint id) : id_(id), fConstructed_(0) {}
-#if YADSL_TEST_CLASSINSTANCEMEMBLOCKPOOL // if test on
-        ~MemBlock() { printf("MemBlock(%d) dtor\n", id_); }
 #endif
     };
 
     typedef MemBlock* PMemBlock;
-#ifdef YADSL_USE_IDVALUEVECTOR_IN_CLASSINSTANCEMEMBLOCKPOOL
-    typedef IdValueVector<wxSharedPtr<MemBlock> > MemBlockMap;
-#else
-    typedef std::map<uint, wxSharedPtr<MemBlock> > MemBlockMap;
-#endif
 
-    UniqIntGenerator uig_; // генератор уникальных целочисленных идентификаторов
-    MemBlockMap pool_;      // пул свободных блоков памяти
-
-    // Получить указатель на память блока по его идентификатору
-    uint8_t* Mem(uint blockId) {
-#ifdef YADSL_USE_IDVALUEVECTOR_IN_CLASSINSTANCEMEMBLOCKPOOL
-        IdValueVector::Element* freeBlockPos= pool_.Find(blockId);
-    #ifdef YADSL_USE_WXDEBUG
-        wxASSERT(freeBlockPos != 0);
-        wxASSERT(blockId == freeBlockPos->GetValue()->id_);
-    #endif
-        return &freeBlockPos->GetValue()->data_[0];
-
-#else // std::map
-        typename MemBlockMap::iterator freeBlockPos = pool_.find(blockId);
-    #ifdef YADSL_USE_WXDEBUG
-        wxASSERT(freeBlockPos != pool_.end());
-        wxASSERT(blockId == freeBlockPos->second->id_);
-    #endif
-        return &freeBlockPos->second->data_[0];
+    // Заголовок сляба, лежит в начале сляба перед блоками
+    struct SlabHeader {
+        uint index_;            // номер сляба, блоки сляба имеют идентификаторы index_ * SlabSize() + i
+        uint liveNum_;          // число выданных блоков сляба
+        uint touchedNum_;       // число блоков от начала сляба, которые хоть раз выдавались
+        PMemBlock freeList_;    // голова списка возвращенных свободных блоков сляба
+        SlabHeader* prev_;      // соседи в списке частично занятых слябов (у пустого сляба next_ - следующий пустой)
+        SlabHeader* next_;
+        uint64_t constructed_[1]; // битовая карта сконструированности блоков, продолжается за пределы структуры
+    };
+
+    std::vector<SlabHeader*> slabs_;    // слябы по номерам, на месте возвращенного в кучу сляба - 0
+    std::vector<SlabHeader*> slabsByAddr_; // слябы по возрастанию адреса, для обхода экземпляров
+    size_t slabBytes_;                  // размер сляба в байтах (степень двойки, по нему же сляб выровнен)
+    size_t blocksOffset_;               // смещение первого блока от начала сляба
+    uint slabSize_;                     // число блоков в слябе
+    uint bitmapWords_;                  // число слов в битовой карте сляба
+    SlabHeader* partial_;               // голова списка частично занятых слябов, из первого выдаются блоки
+    SlabHeader* empty_;                 // голова списка пустых слябов
+    uint slabNum_;                      // число слябов в пуле
+    uint emptySlabNum_;                 // число пустых слябов
+    uint liveBlockNum_;                 // число выданных блоков
+    uint reserve_;                      // сколько свободных блоков Trim() оставляет в пуле (@see Reserve())
+    uint trimHigh_;                     // число пустых слябов, при превышении которого пул сам возвращает слябы в кучу
+    uint trimLow_;                      // число пустых слябов, до которого пул возвращает слябы в кучу
+    PageArena* arena_;                  // арена страниц, из которой выделяются слябы, 0 - куча
+    AllocStats stats_;                  // счетчики пула
+
+    // Рассчитать размещение блоков в слябе для желаемого числа блоков
+    void InitLayout(uint slabSize) {
+        uint n = (slabSize == 0) ? 1 : slabSize;
+        slabBytes_ = RoundUpPow2(BlocksOffset(n) + sizeof(MemBlock) * n);
+        // остаток степени двойки тоже заполняется блоками, место под битовую карту растет вместе с их числом
+        n = (slabBytes_ - BlocksOffset(n)) / sizeof(MemBlock);
+        while (BlocksOffset(n) + sizeof(MemBlock) * n > slabBytes_) --n;
+        slabSize_ = n;
+        bitmapWords_ = (n + 63) / 64;
+        blocksOffset_ = BlocksOffset(n);
+    }
+
+    // Смещение первого блока для сляба из n блоков: заголовок и битовая карта
+    static size_t BlocksOffset(uint n) {
+        return AlignUp(offsetof(SlabHeader, constructed_) + (n + 63) / 64 * sizeof(uint64_t), alignof(MemBlock));
+    }
+
+    void* AllocSlabMem() {
+        return (arena_ != 0) ? arena_->Alloc(slabBytes_, slabBytes_) : AlignedAlloc(slabBytes_, slabBytes_);
+    }
+
+    void FreeSlabMem(SlabHeader* slab) {
+        if (arena_ != 0) {
+            arena_->Free(slab, slabBytes_, slabBytes_);
+        }
+        else {
+            AlignedFree(slab);
+        }
+    }
+
+    // Добавить пустой сляб из кучи в список пустых слябов, номер берется наименьший свободный
+    bool AddSlab() {
+        SlabHeader* slab = static_cast<SlabHeader*>(AllocSlabMem());
+        if (slab == 0) {
+            return false;
+        }
+        uint index = 0;
+        while (index < slabs_.size() && slabs_[index] != 0) ++index;
+        if (index == slabs_.size()) {
+            slabs_.push_back(slab);
+        }
+        else {
+            slabs_[index] = slab;
+        }
+        slabsByAddr_.insert(std::lower_bound(slabsByAddr_.begin(), slabsByAddr_.end(), slab), slab);
+        slab->index_ = index;
+        slab->liveNum_ = 0;
+        slab->touchedNum_ = 0;
+        slab->freeList_ = 0;
+        memset(slab->constructed_, 0, bitmapWords_ * sizeof(uint64_t));
+        slab->next_ = empty_;
+        empty_ = slab;
+        ++slabNum_;
+        ++emptySlabNum_;
+        stats_.OnReserve(slabBytes_);
+        return true;
+    }
+
+    // Вернуть в кучу пустой сляб из головы списка пустых слябов
+    void ReleaseEmptySlab() {
+        SlabHeader* slab = empty_;
+        empty_ = slab->next_;
+        slabs_[slab->index_] = 0;
+        while (!slabs_.empty() && slabs_.back() == 0) slabs_.pop_back();
+        slabsByAddr_.erase(std::lower_bound(slabsByAddr_.begin(), slabsByAddr_.end(), slab));
+        --slabNum_;
+        --emptySlabNum_;
+        stats_.OnRelease(slabBytes_);
+        FreeSlabMem(slab);
+    }
+
+    // Вернуть в кучу пустые слябы сверх keepEmpty, не опускаясь ниже резерва свободных блоков
+    uint ReleaseEmptySlabs(uint keepEmpty) {
+        uint released = 0;
+        while (emptySlabNum_ > keepEmpty && FreeBlockNum() >= reserve_ + slabSize_) {
+            ReleaseEmptySlab();
+            ++released;
+        }
+        return released;
+    }
+
+    void LinkPartial(SlabHeader* slab) {
+        slab->prev_ = 0;
+        slab->next_ = partial_;
+        if (partial_ != 0) partial_->prev_ = slab;
+        partial_ = slab;
+    }
+
+    void UnlinkPartial(SlabHeader* slab) {
+        if (slab->prev_ != 0) slab->prev_->next_ = slab->next_;
+        else partial_ = slab->next_;
+        if (slab->next_ != 0) slab->next_->prev_ = slab->prev_;
+    }
+
+    // Выделить блок из сляба, стоящего в списке частично занятых слябов
+    void* AllocFromSlab(SlabHeader* slab) {
+        PMemBlock block = slab->freeList_;
+        if (block != 0) {
+            slab->freeList_ = block->nextFree_;
+        }
+        else {
+            block = FirstBlock(slab) + slab->touchedNum_++;
+        }
+        if (++slab->liveNum_ == slabSize_) {
+            UnlinkPartial(slab); // сляб заполнен
+        }
+        ++liveBlockNum_;
+#ifdef YADSL_USE_WXDEBUG
+        block->fConstructed_ = 0;
 #endif
+        return static_cast<void*>(&block->data_[0]);
+    }
+
+    // Число сконструированных экземпляров в слябе
+    uint ConstructedNum(const SlabHeader* slab) const {
+        uint n = 0;
+        for (uint w = 0; w < bitmapWords_; ++w) {
+            n += Popcount64(slab->constructed_[w]);
+        }
+        return n;
     }
 
+    PMemBlock FirstBlock(SlabHeader* slab) const {
+        return reinterpret_cast<PMemBlock>(reinterpret_cast<uint8_t*>(slab) + blocksOffset_);
+    }
+
+    // Сляб, которому принадлежит блок: слябы выровнены по своему размеру
+    SlabHeader* SlabOf(const void* p) const {
+        return reinterpret_cast<SlabHeader*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(slabBytes_ - 1));
+    }
+
+    // Индекс блока в слябе
+    uint IndexInSlab(SlabHeader* slab, const void* p) const {
+        return (reinterpret_cast<const uint8_t*>(p) - reinterpret_cast<const uint8_t*>(FirstBlock(slab))) / sizeof(MemBlock);
+    }
+
+    ClassInstanceMemBlockPool(const ClassInstanceMemBlockPool&);
+    ClassInstanceMemBlockPool& operator=(const ClassInstanceMemBlockPool&);
+
 public:
+    enum { kDefaultSlabSize = 64 }; ///< число блоков в слябе по умолчанию
+    enum { kNoAutoTrim = 0xFFFFFFFF }; ///< значение порога SetAutoTrim(), отключающее автоматический возврат слябов
+
+    /** @brief Конструктор.
+    @param slabSize число блоков в слябе.
+    @param arena арена страниц, из которой выделяются слябы (@see PageArena), 0 - слябы выделяются из кучи.
+    Арена должна пережить пул. Для пулов на арене выгодны большие слябы, не меньше страницы.
+    */
+    explicit ClassInstanceMemBlockPool(uint slabSize = kDefaultSlabSize, PageArena* arena = 0) :
+        partial_(0), empty_(0), slabNum_(0), emptySlabNum_(0), liveBlockNum_(0), reserve_(0),
+        trimHigh_(kNoAutoTrim), trimLow_(kNoAutoTrim), arena_(arena),
+        stats_("ClassInstanceMemBlockPool", sizeof(MemBlock)) {
+        InitLayout(slabSize);
+    }
+
+    ~ClassInstanceMemBlockPool() {
+        for (size_t i = 0; i < slabs_.size(); ++i) {
+            if (slabs_[i] != 0) FreeSlabMem(slabs_[i]);
+        }
+    }
+
     /** @brief Выделить свободный блок памяти.
 
-    @note Если в пуле не останется свободных блоков, они будут добавлены в пул из кучи.
+    @note Если в пуле не останется свободных блоков, в пул будет добавлен сляб из кучи.
     */
     void* Alloc() {
-        bool fUigEmpty = (uig_.Unused() == 0) ? true: false;
-        uint blockId = kNoId;
-        if (fUigEmpty) {
-            PMemBlock memBlock = new(std::nothrow) MemBlock(blockId);
-            if (memBlock == 0) {
-                return 0;
+        SlabHeader* slab = partial_;
+        bool fCacheHit = true;
+        if (slab == 0) {
+            if (empty_ == 0) {
+                if (!AddSlab()) {
+                    return 0;
+                }
+                fCacheHit = false;
             }
-            blockId = uig_.Get();
-            memBlock->id_ = blockId;
-#ifdef YADSL_USE_IDVALUEVECTOR_IN_CLASSINSTANCEMEMBLOCKPOOL
-            pool_.Insert(blockId, wxSharedPtr<MemBlock>(memBlock));
-#else
-            pool_[blockId] = wxSharedPtr<MemBlock>(memBlock);
-#endif
+            slab = empty_;
+            empty_ = slab->next_;
+            --emptySlabNum_;
+            LinkPartial(slab);
         }
-        else {
-            blockId = uig_.Get();
-        }
-        return static_cast<void*>(Mem(blockId));
+        stats_.OnAlloc(fCacheHit);
+        return AllocFromSlab(slab);
     }
 
     /** @brief Вернуть блок в пул свободных блоков.
@@ -133,51 +332,282 @@ public:
     другой экземпляр. Может возникнуть логическая ошибка, когда данные в блоке будут изменяться через старый указатель.
     Рекомендуется приравнять заданный указатель к нулю после вызова этой функции.
 
-    @note Блок не возвращается в кучу.
+    @note Блок возвращается в кучу только вместе со всем слябом (@see Trim(), SetAutoTrim()).
     */
     void Free(void* p, bool fEraseMemContent = false) {
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT(p != 0);
+        wxASSERT_MSG(!MarkedAsConstructed(p), wxT("instance must be destructed before its block is freed"));
 #endif
         PMemBlock block = reinterpret_cast<PMemBlock>(p);
-        uig_.Put(block->id_);
         if (fEraseMemContent) {
             memset(&block->data_[0], 0, sizeof(block->data_));
         }
 #if YADSL_TEST_CLASSINSTANCEMEMBLOCKPOOL // if test on
         strcpy((char*)block->data_, "unnamed");
 #endif
+        SlabHeader* slab = SlabOf(p);
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(slab->liveNum_ > 0);
+#endif
+        block->nextFree_ = slab->freeList_;
+        slab->freeList_ = block;
+        --liveBlockNum_;
+        stats_.OnFree();
+        if (slab->liveNum_-- == slabSize_) {
+            LinkPartial(slab); // в заполненном слябе появился свободный блок
+        }
+        if (slab->liveNum_ == 0) {
+            // сляб опустел: он уходит в список пустых слябов и может быть возвращен в кучу
+            UnlinkPartial(slab);
+            slab->next_ = empty_;
+            empty_ = slab;
+            if (++emptySlabNum_ > trimHigh_) {
+                ReleaseEmptySlabs(trimLow_);
+            }
+        }
+    }
+
+    /** @brief Вернуть в кучу пустые слябы.
+    Свободных блоков в пуле остается не меньше резерва, заданного Reserve().
+    @param keepEmptySlabs сколько пустых слябов оставить в пуле.
+    @return число возвращенных в кучу слябов.
+    */
+    uint Trim(uint keepEmptySlabs = 0) {
+        return ReleaseEmptySlabs(keepEmptySlabs);
+    }
+
+    /** @brief Задать политику автоматического возврата пустых слябов в кучу.
+    Когда число пустых слябов превышает highWater, Free() возвращает пустые слябы в кучу, пока их не останется lowWater.
+    Разрыв между порогами - гистерезис: пул, колеблющийся у границы сляба, не выделяет и не возвращает сляб на каждой операции.
+    @param highWater порог срабатывания, kNoAutoTrim - не возвращать слябы автоматически (по умолчанию).
+    @param lowWater число пустых слябов после срабатывания, не больше highWater.
+    */
+    void SetAutoTrim(uint highWater, uint lowWater) {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(lowWater <= highWater);
+#endif
+        trimHigh_ = highWater;
+        trimLow_ = lowWater;
+        if (emptySlabNum_ > trimHigh_) {
+            ReleaseEmptySlabs(trimLow_);
+        }
+    }
+
+    /** @brief Заранее выделить слябы так, чтобы в пуле было не меньше n свободных блоков.
+    Следующие выделения до n блоков обойдутся без обращения к куче. Заданный резерв запоминается:
+    Trim() и автоматический возврат не опускают число свободных блоков ниже n. Reserve(0) снимает резерв.
+    @return false при нехватке памяти.
+    */
+    bool Reserve(uint n) {
+        reserve_ = n;
+        while (FreeBlockNum() < n) {
+            if (!AddSlab()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** @brief Идентификатор блока: число, уникальное среди блоков пула.
+    Вычисляется по адресу блока, в самом блоке не хранится. Номера возвращенных в кучу слябов занимаются новыми слябами,
+    поэтому идентификаторы остаются плотными: они меньше наибольшего числа одновременно занятых слябов, умноженного на SlabSize().
+    */
+    uint BlockId(const void* p) const {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(p != 0);
+#endif
+        SlabHeader* slab = SlabOf(p);
+        return slab->index_ * slabSize_ + IndexInSlab(slab, p);
+    }
+
+    /** @brief Выделить блок и сконструировать в нем экземпляр, передав конструктору заданные аргументы.
+    Блок помечается как сконструированный.
+    @return указатель на экземпляр или 0 при нехватке памяти.
+    */
+    template <typename... A>
+    T* Construct(A&&... args) {
+        void* p = Alloc();
+        if (p == 0) {
+            return 0;
+        }
+        T* instance = 0;
+        try {
+            instance = new(p) T(std::forward<A>(args)...);
+        }
+        catch (...) {
+            Free(p);
+            throw;
+        }
+        MarkAsConstructed(p);
+        return instance;
+    }
+
+    /** @brief Разрушить экземпляр, созданный Construct() (или помеченный MarkAsConstructed()), и вернуть его блок в пул.
+    */
+    void Destroy(T* instance) {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(instance != 0);
+        wxASSERT(MarkedAsConstructed(instance));
+#endif
+        instance->~T();
+        MarkAsDestructed(instance);
+        Free(instance);
     }
 
     /// Возвращает true, если заданный блок был помечен как блок, в котором сконструирован экземпляр класса
-    bool MarkedAsConstructed(void* p) const {
+    bool MarkedAsConstructed(const void* p) const {
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT(p != 0);
 #endif
-        MemBlock* block = reinterpret_cast<PMemBlock>(p);
-        return block->fConstructed_ == 0xA965;
+        SlabHeader* slab = SlabOf(p);
+        uint index = IndexInSlab(slab, p);
+        bool fConstructed = ((slab->constructed_[index >> 6] >> (index & 63)) & 1) != 0;
+#ifdef YADSL_USE_WXDEBUG
+        const MemBlock* block = reinterpret_cast<const MemBlock*>(p);
+        wxASSERT_MSG(fConstructed == (block->fConstructed_ == 0xA965), wxT("block construction mark is corrupted"));
+#endif
+        return fConstructed;
     }
 
     /// Пометить заданный блок как блок, в котором сконструирован экземпляр класса
     void MarkAsConstructed(void* p) {
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT(p != 0);
+        reinterpret_cast<PMemBlock>(p)->fConstructed_ = 0xA965;
 #endif
-        MemBlock* block = reinterpret_cast<PMemBlock>(p);
-        block->fConstructed_ = 0xA965;
+        SlabHeader* slab = SlabOf(p);
+        uint index = IndexInSlab(slab, p);
+        slab->constructed_[index >> 6] |= uint64_t(1) << (index & 63);
     }
 
     /// Снять метку с заданного блока как блока, в котором сконструирован экземпляр класса
     void MarkAsDestructed(void* p) {
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT(p != 0);
+        reinterpret_cast<PMemBlock>(p)->fConstructed_ = 0;
 #endif
-        MemBlock* block = reinterpret_cast<PMemBlock>(p);
-        block->fConstructed_ = 0;
+        SlabHeader* slab = SlabOf(p);
+        uint index = IndexInSlab(slab, p);
+        slab->constructed_[index >> 6] &= ~(uint64_t(1) << (index & 63));
+    }
+
+    /** @brief Уплотнить экземпляры: переместить часть экземпляров из самых разреженных слябов в самые плотные.
+
+    За вызов перемещается не больше budget экземпляров, поэтому уплотнение можно растянуть на несколько кадров,
+    вызывая Compact() с небольшим бюджетом. Экземпляр переносится конструктором перемещения в блок самого плотного
+    частично занятого сляба, затем вызывается relocate(from, to), и старый экземпляр разрушается. Источником берется
+    самый разреженный сляб, все выделенные блоки которого сконструированы и помещаются в свободные блоки других слябов,
+    поэтому каждое перемещение приближает освобождение сляба. Опустевшие слябы возвращаются в кучу по политике
+    SetAutoTrim() или явным вызовом Trim().
+
+    @code
+    // владельцы хранят указатели на экземпляры пула и должны их исправить
+    pool.Compact(256, [](Person* from, Person* to) { Owner(from)->person_ = to; });
+    pool.Trim();
+    @endcode
+    @param budget наибольшее число перемещаемых экземпляров.
+    @param relocate функтор с оператором void operator()(T* from, T* to), вызывается после конструирования экземпляра
+    на новом месте и до разрушения старого. Не должен выделять и освобождать блоки этого пула.
+    @return число перемещенных экземпляров, 0 - уплотнять больше нечего.
+    */
+    template <typename F>
+    uint Compact(uint budget, F&& relocate) {
+        uint moved = 0;
+        while (moved < budget) {
+            // самый разреженный сляб, который можно опустошить, и свободное место в остальных частично занятых слябах
+            SlabHeader* src = 0;
+            uint freeNum = 0;
+            for (SlabHeader* slab = partial_; slab != 0; slab = slab->next_) {
+                freeNum += slabSize_ - slab->liveNum_;
+                if ((src == 0 || slab->liveNum_ < src->liveNum_) && ConstructedNum(slab) == slab->liveNum_) {
+                    src = slab;
+                }
+            }
+            if (src == 0 || freeNum - (slabSize_ - src->liveNum_) < src->liveNum_) {
+                break;
+            }
+            uint left = src->liveNum_; // сляб может быть возвращен в кучу вместе с последним экземпляром
+            UnlinkPartial(src); // чтобы не выбрать источник приемником
+            while (moved < budget && left > 0) {
+                SlabHeader* dst = partial_;
+                for (SlabHeader* slab = partial_; slab != 0; slab = slab->next_) {
+                    if (slab->liveNum_ > dst->liveNum_) dst = slab;
+                }
+                uint w = 0;
+                while (src->constructed_[w] == 0) ++w;
+                T* from = reinterpret_cast<T*>(&FirstBlock(src)[(w << 6) + Ctz64(src->constructed_[w])].data_[0]);
+                void* p = AllocFromSlab(dst);
+                stats_.OnAlloc(true);
+                T* to = 0;
+                try {
+                    to = new(p) T(std::move(*from));
+                }
+                catch (...) {
+                    Free(p);
+                    LinkPartial(src);
+                    throw;
+                }
+                MarkAsConstructed(to);
+                relocate(from, to);
+                from->~T();
+                MarkAsDestructed(from);
+                if (--left == 0) {
+                    LinkPartial(src); // Free() переведет опустевший сляб в список пустых
+                }
+                Free(from);
+                ++moved;
+            }
+            if (left > 0) {
+                LinkPartial(src);
+            }
+        }
+        return moved;
+    }
+
+    /** @brief Обойти все сконструированные экземпляры (помеченные как сконструированные) в порядке возрастания адресов.
+
+    Слябы обходятся по возрастанию адреса, внутри сляба свободные и несконструированные блоки пропускаются
+    по битовой карте сконструированности - по слову на 64 блока, пустые слябы пропускаются целиком.
+    Экземпляры читаются из памяти подряд, что удобно для пакетной обработки компонент.
+    @code
+    pool.ForEachLive([](Person* p) { ++p->age_; });
+    @endcode
+    @param fn функтор с оператором void operator()(T*). Не должен выделять и освобождать блоки этого пула.
+    */
+    template <typename F>
+    void ForEachLive(F&& fn) {
+        for (size_t s = 0; s < slabsByAddr_.size(); ++s) {
+            SlabHeader* slab = slabsByAddr_[s];
+            if (slab->liveNum_ == 0) continue;
+            PMemBlock first = FirstBlock(slab);
+            const uint words = (slab->touchedNum_ + 63) / 64;
+            for (uint w = 0; w < words; ++w) {
+                uint64_t word = slab->constructed_[w];
+                while (word != 0) {
+                    uint index = (w << 6) + Ctz64(word);
+                    word &= word - 1;
+                    fn(reinterpret_cast<T*>(&first[index].data_[0]));
+                }
+            }
+        }
     }
 
     /// Возвращает число всех блоков, свободных и выделенных. Для оценки потребления памяти и отладки.
-    int AllBlockNum() const { return uig_.Num(); }
+    int AllBlockNum() const { return slabNum_ * slabSize_; }
+    /// Возвращает число выделенных блоков
+    uint LiveBlockNum() const { return liveBlockNum_; }
+    /// Возвращает число свободных блоков, которые можно выделить без обращения к куче
+    uint FreeBlockNum() const { return slabNum_ * slabSize_ - liveBlockNum_; }
+    /// Возвращает число слябов в пуле
+    uint SlabNum() const { return slabNum_; }
+    /// Возвращает число пустых слябов, которые можно вернуть в кучу
+    uint EmptySlabNum() const { return emptySlabNum_; }
+    /// Возвращает число блоков в слябе
+    uint SlabSize() const { return slabSize_; }
+    /// Счетчики пула (@see AllocStats). Перемещение экземпляра Compact() учитывается как выделение и освобождение.
+    AllocStats& Stats() { return stats_; }
+    const AllocStats& Stats() const { return stats_; }
 };
 
 } // end of yadsl
@@ -203,15 +633,17 @@ public:
         strcpy(name_, name);
     }
 
-    void Print() {
-        int* blockId = (int*)(this + 1);
-        printf("I am %s and %d years old (block id: %d)\n", name_, age_, *blockId);
-    }
+    void Print();
 };
 
+yadsl::ClassInstanceMemBlockPool <Dummy> memPool;
+
+void Dummy::Print() {
+    printf("I am %s and %d years old (block id: %d)\n", name_, age_, memPool.BlockId(this));
+}
+
 void Test() {
 
-    yadsl::ClassInstanceMemBlockPool <Dummy> memPool;
     void* p = memPool.Alloc();
     Dummy* d1 = new(p) Dummy("Petrovich", 65);
     p = memPool.Alloc();
@@ -269,5 +701,85 @@ int main(){
 
 #endif
 
+//-----------------------------------------------------------------------------
+
+#if 0 // code for benchmark
+
+// Потоки пишут каждый в свой экземпляр, экземпляры выделены из пула подряд.
+// Сравниваются: прежняя раскладка блока (данные без выравнивания + id_ + fConstructed_),
+// выровненные блоки по умолчанию и блоки, дополненные до строки кэша.
+
+#include <stdio.h> // printf()
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <wx/wx.h>
+
+#include "ClassInstMemBlockPool.h"
+
+struct Counter {
+    volatile uint64_t value_;
+    Counter() : value_(0) {}
+};
+
+// Прежняя раскладка блока, блоки лежат вплотную в массиве
+struct OldMemBlock {
+    uint8_t data_[sizeof(Counter)];
+    int id_;
+    int fConstructed_;
+};
+
+const int kIterations = 50000000;
+
+template <typename GetCounter>
+double Run(int threadNum, GetCounter getCounter) {
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadNum; ++t) {
+        Counter* c = getCounter(t);
+        threads.push_back(std::thread([c]() {
+            for (int i = 0; i < kIterations; ++i) {
+                c->value_ = c->value_ + 1;
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    const int kMaxThreads = 8;
+
+    static OldMemBlock oldBlocks[kMaxThreads];
+    yadsl::ClassInstanceMemBlockPool<Counter> packedPool;
+    yadsl::ClassInstanceMemBlockPool<Counter, yadsl::kMemPool_CacheLinePadded> paddedPool;
+    Counter* packed[kMaxThreads];
+    Counter* padded[kMaxThreads];
+    for (int t = 0; t < kMaxThreads; ++t) {
+        new(oldBlocks[t].data_) Counter();
+        packed[t] = packedPool.Construct();
+        padded[t] = paddedPool.Construct();
+    }
+
+    printf("block bytes: old %d, packed %d, padded %d\n", (int)sizeof(OldMemBlock),
+           (int)((uint8_t*)packed[1] - (uint8_t*)packed[0]), (int)((uint8_t*)padded[1] - (uint8_t*)padded[0]));
+    for (int threadNum = 1; threadNum <= kMaxThreads; threadNum *= 2) {
+        double oldTime = Run(threadNum, [&](int t) { return reinterpret_cast<Counter*>(oldBlocks[t].data_); });
+        double packedTime = Run(threadNum, [&](int t) { return packed[t]; });
+        double paddedTime = Run(threadNum, [&](int t) { return padded[t]; });
+        printf("%d threads: old %.3f s, packed %.3f s, padded %.3f s\n", threadNum, oldTime, packedTime, paddedTime);
+    }
+
+    for (int t = 0; t < kMaxThreads; ++t) {
+        packedPool.Destroy(packed[t]);
+        paddedPool.Destroy(padded[t]);
+    }
+    return 0;
+}
+
+#endif
+
 #endif // YADSL_CLASSINSTMEMBLOCKPOOL_H_
 
@@ -0,0 +1,342 @@
+#ifndef YADSL_CONCCLASSINSTMEMBLOCKPOOL_H_
+#define YADSL_CONCCLASSINSTMEMBLOCKPOOL_H_
+
+/** @file ConcClassInstMemBlockPool.h.
+
+Назначение: пул блоков памяти для экземпляров заданного типа, разделяемый между потоками.
+*/
+
+#include <vector>
+#include <mutex>
+#include <new>
+#include <algorithm> // std::copy()
+#include <utility> // std::forward()
+
+#include <wx/wx.h>
+
+#include "BaseTypes.h"
+#include "ClassInstMemBlockPool.h"
+
+namespace yadsl
+{
+
+/** @brief Потокобезопасный пул блоков памяти с магазинами блоков в потоках.
+
+Каждый рабочий поток заводит свой кэш ThreadCache - магазин свободных блоков. Alloc() и Free() кэша работают
+с магазином без блокировок и атомарных операций. Пустой магазин пополняется, а переполненный опустошается пачками
+по BatchSize() блоков через общее хранилище (депо) - стек свободных блоков под мьютексом. Блоки в депо попадают
+и из него берутся пачками копированием указателей, поэтому мьютекс захватывается один раз на пачку.
+Когда депо пусто, блоки для пачки выделяются из обычного пула ClassInstanceMemBlockPool (тоже под мьютексом).
+
+Блок можно освободить в любом потоке, а не только в выделившем его: он попадает в магазин освобождающего потока
+и через депо становится доступен всем потокам. Поэтому схема "производитель выделяет, потребитель освобождает"
+работает без дополнительных очередей.
+
+Пример:
+@code
+ConcurrentClassInstanceMemBlockPool<Particle> pool;
+// в каждом рабочем потоке
+ConcurrentClassInstanceMemBlockPool<Particle>::ThreadCache cache(pool);
+Particle* p = cache.Construct(x, y);
+//...
+cache.Destroy(p); // можно и в другом потоке, через его кэш
+@endcode
+
+@note метки сконструированности (MarkAsConstructed()) и обход ForEachLive() обычного пула здесь не поддерживаются:
+битовые карты слябов общие для блоков разных потоков. Блоки, лежащие в магазинах и в депо, для обычного пула
+считаются выделенными, поэтому Trim() предварительно возвращает в него блоки депо.
+*/
+template <typename T, int Flags = 0>
+class ConcurrentClassInstanceMemBlockPool {
+public:
+    /** @brief Кэш блоков одного потока (магазин).
+    Экземпляр должен использоваться только создавшим его потоком и уничтожаться раньше пула.
+    При уничтожении все блоки магазина возвращаются в депо.
+    */
+    class ThreadCache {
+    private:
+        ConcurrentClassInstanceMemBlockPool& owner_;
+        std::vector<void*> magazine_;   // свободные блоки, емкость - две пачки
+        uint count_;                    // число блоков в магазине
+
+        void Refill() {
+            count_ = owner_.TakeBatch(&magazine_[0]);
+        }
+
+        void Drain() {
+            count_ -= owner_.batch_;
+            owner_.PutBatch(&magazine_[count_], owner_.batch_);
+        }
+
+        ThreadCache(const ThreadCache&);
+        ThreadCache& operator=(const ThreadCache&);
+
+    public:
+        explicit ThreadCache(ConcurrentClassInstanceMemBlockPool& owner) :
+            owner_(owner), magazine_(2 * owner.batch_), count_(0) {
+        }
+
+        ~ThreadCache() {
+            Flush();
+        }
+
+        /** @brief Выделить свободный блок памяти.
+        @return блок или 0 при нехватке памяти.
+        */
+        void* Alloc() {
+            if (count_ == 0) {
+                Refill();
+                if (count_ == 0) {
+                    return 0;
+                }
+            }
+            return magazine_[--count_];
+        }
+
+        /// Вернуть блок в магазин. Блок может быть выделен любым потоком.
+        void Free(void* p) {
+#ifdef YADSL_USE_WXDEBUG
+            wxASSERT(p != 0);
+#endif
+            if (count_ == magazine_.size()) {
+                Drain();
+            }
+            magazine_[count_++] = p;
+        }
+
+        /** @brief Выделить блок и сконструировать в нем экземпляр, передав конструктору заданные аргументы.
+        @return указатель на экземпляр или 0 при нехватке памяти.
+        */
+        template <typename... A>
+        T* Construct(A&&... args) {
+            void* p = Alloc();
+            if (p == 0) {
+                return 0;
+            }
+            try {
+                return new(p) T(std::forward<A>(args)...);
+            }
+            catch (...) {
+                Free(p);
+                throw;
+            }
+        }
+
+        /// Разрушить экземпляр, созданный Construct() любого кэша этого пула, и вернуть его блок в магазин
+        void Destroy(T* instance) {
+#ifdef YADSL_USE_WXDEBUG
+            wxASSERT(instance != 0);
+#endif
+            instance->~T();
+            Free(instance);
+        }
+
+        /// Вернуть все блоки магазина в депо
+        void Flush() {
+            if (count_ != 0) {
+                owner_.PutBatch(&magazine_[0], count_);
+                count_ = 0;
+            }
+        }
+    };
+
+private:
+    std::mutex mutex_;                          // защищает pool_ и depot_
+    ClassInstanceMemBlockPool<T, Flags> pool_;  // источник блоков для депо
+    std::vector<void*> depot_;                  // свободные блоки, возвращенные кэшами потоков
+    const uint batch_;                          // размер пачки обмена между магазином и депо
+
+    // Взять пачку блоков из депо (или из пула, если в депо пусто), возвращает число взятых блоков
+    uint TakeBatch(void** out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint n = 0;
+        if (!depot_.empty()) {
+            n = depot_.size() < batch_ ? uint(depot_.size()) : batch_;
+            std::copy(depot_.end() - n, depot_.end(), out);
+            depot_.resize(depot_.size() - n);
+        }
+        for (; n < batch_; ++n) {
+            void* p = pool_.Alloc();
+            if (p == 0) break;
+            out[n] = p;
+        }
+        return n;
+    }
+
+    // Положить блоки в депо
+    void PutBatch(void* const* blocks, uint n) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        depot_.insert(depot_.end(), blocks, blocks + n);
+    }
+
+    ConcurrentClassInstanceMemBlockPool(const ConcurrentClassInstanceMemBlockPool&);
+    ConcurrentClassInstanceMemBlockPool& operator=(const ConcurrentClassInstanceMemBlockPool&);
+
+public:
+    /** @brief Конструктор.
+    @param batchSize число блоков в пачке обмена между магазином потока и депо.
+    @param slabSize число блоков в слябе пула (@see ClassInstanceMemBlockPool).
+    @param arena арена страниц для слябов пула, 0 - куча. Обращения к арене идут под мьютексом пула.
+    */
+    explicit ConcurrentClassInstanceMemBlockPool(uint batchSize = 64, uint slabSize = ClassInstanceMemBlockPool<T, Flags>::kDefaultSlabSize,
+                                                 PageArena* arena = 0) :
+        pool_(slabSize, arena), batch_(batchSize == 0 ? 1 : batchSize) {
+    }
+
+    /// Размер пачки обмена между магазином потока и депо
+    uint BatchSize() const { return batch_; }
+
+    /** @brief Заранее выделить слябы так, чтобы в пуле было не меньше n свободных блоков (@see ClassInstanceMemBlockPool::Reserve()).
+    @return false при нехватке памяти.
+    */
+    bool Reserve(uint n) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pool_.Reserve(n);
+    }
+
+    /** @brief Вернуть блоки депо в пул и пустые слябы пула в кучу (@see ClassInstanceMemBlockPool::Trim()).
+    Блоки, лежащие в магазинах потоков, остаются выделенными.
+    @return число возвращенных в кучу слябов.
+    */
+    uint Trim(uint keepEmptySlabs = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < depot_.size(); ++i) {
+            pool_.Free(depot_[i]);
+        }
+        depot_.clear();
+        return pool_.Trim(keepEmptySlabs);
+    }
+
+    /// Число блоков в депо
+    uint DepotBlockNum() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return depot_.size();
+    }
+
+    /// Число всех блоков пула, включая блоки депо и магазинов. Для оценки потребления памяти и отладки.
+    int AllBlockNum() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pool_.AllBlockNum();
+    }
+
+    /** @brief Счетчики внутреннего пула (@see AllocStats). Блоки, выданные в депо и магазины, считаются в нем живыми,
+    поэтому счетчики показывают обмен с пулом пачками, а не выделения в потоках. Читать можно без блокировки.
+    */
+    const AllocStats& Stats() const { return pool_.Stats(); }
+
+    /// Задать имя счетчиков для выгрузки, до начала работы потоков
+    void SetStatsName(const char* name) { pool_.Stats().SetName(name); }
+};
+
+} // end of yadsl
+
+
+//-----------------------------------------------------------------------------
+
+#if 0 // code for benchmark
+
+// Пропускная способность Alloc()/Free() от 1 до 16 потоков: кэши потоков против обычного пула под общим мьютексом.
+// Во второй половине каждого раунда поток освобождает блоки, выделенные соседним потоком.
+
+#include <stdio.h> // printf()
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <chrono>
+#include <wx/wx.h>
+
+#include "ConcClassInstMemBlockPool.h"
+
+struct Particle {
+    float pos_[3];
+    float vel_[3];
+};
+
+const int kRounds = 2000;
+const int kPerRound = 256;
+
+// Простой барьер для раундов обмена блоками между потоками
+class Barrier {
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int count_, waiting_, phase_;
+public:
+    explicit Barrier(int count) : count_(count), waiting_(0), phase_(0) {}
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int phase = phase_;
+        if (++waiting_ == count_) {
+            waiting_ = 0;
+            ++phase_;
+            cv_.notify_all();
+        }
+        else {
+            cv_.wait(lock, [&]() { return phase != phase_; });
+        }
+    }
+};
+
+template <typename AllocFn, typename FreeFn>
+void Worker(int t, int threadNum, std::vector<std::vector<void*> >& slots, Barrier& barrier, AllocFn alloc, FreeFn release) {
+    std::vector<void*>& mine = slots[t];
+    for (int r = 0; r < kRounds; ++r) {
+        // выделение и освобождение в своем потоке
+        for (int i = 0; i < kPerRound; ++i) mine[i] = alloc();
+        for (int i = 0; i < kPerRound / 2; ++i) release(mine[i]);
+        for (int i = 0; i < kPerRound / 2; ++i) mine[i] = alloc();
+        barrier.Wait();
+        // освобождение блоков соседа
+        std::vector<void*>& other = slots[(t + 1) % threadNum];
+        for (int i = 0; i < kPerRound; ++i) release(other[i]);
+        barrier.Wait();
+    }
+}
+
+double RunCached(int threadNum) {
+    typedef yadsl::ConcurrentClassInstanceMemBlockPool<Particle> Pool;
+    Pool pool;
+    std::vector<std::vector<void*> > slots(threadNum, std::vector<void*>(kPerRound));
+    Barrier barrier(threadNum);
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadNum; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            Pool::ThreadCache cache(pool);
+            Worker(t, threadNum, slots, barrier, [&]() { return cache.Alloc(); }, [&](void* p) { cache.Free(p); });
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double RunLocked(int threadNum) {
+    yadsl::ClassInstanceMemBlockPool<Particle> pool;
+    std::mutex mutex;
+    std::vector<std::vector<void*> > slots(threadNum, std::vector<void*>(kPerRound));
+    Barrier barrier(threadNum);
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadNum; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            Worker(t, threadNum, slots, barrier,
+                   [&]() { std::lock_guard<std::mutex> lock(mutex); return pool.Alloc(); },
+                   [&](void* p) { std::lock_guard<std::mutex> lock(mutex); pool.Free(p); });
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    printf("threads  cached Mops/s  locked Mops/s\n");
+    for (int threadNum = 1; threadNum <= 16; threadNum *= 2) {
+        double ops = 2.0 * kRounds * (kPerRound + kPerRound / 2) * threadNum / 1e6;
+        printf("%7d  %13.1f  %13.1f\n", threadNum, ops / RunCached(threadNum), ops / RunLocked(threadNum));
+    }
+    return 0;
+}
+
+#endif
+
+#endif // YADSL_CONCCLASSINSTMEMBLOCKPOOL_H_
@@ -0,0 +1,233 @@
+#include "ConcUniqIntGen.h"
+#include <algorithm>
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+namespace yadsl
+{
+
+ConcurrentUniqIntGenerator::ConcurrentUniqIntGenerator(uint batchSize) :
+    batch_(batchSize == 0 ? 1 : batchSize), chunks_(new ChunkVec()), num_(0) {
+}
+
+ConcurrentUniqIntGenerator::~ConcurrentUniqIntGenerator() {
+    const ChunkVec* chunks = chunks_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < chunks->size(); ++i) {
+        delete [] (*chunks)[i];
+    }
+    delete chunks;
+    for (size_t i = 0; i < oldChunkVecs_.size(); ++i) {
+        delete oldChunkVecs_[i];
+    }
+}
+
+void ConcurrentUniqIntGenerator::GrowGenerations() {
+    const ChunkVec* chunks = chunks_.load(std::memory_order_relaxed);
+    size_t needed = (uig_.Num() + kChunkMask) >> kChunkShift;
+    if (needed <= chunks->size()) {
+        num_.store(uig_.Num(), std::memory_order_release);
+        return;
+    }
+
+    /* Каталог не изменяется на месте: читатели без блокировок могут держать указатель на старый.
+    Строится новый каталог с прежними кусками и новыми, старый сохраняется до уничтожения генератора.
+    */
+    ChunkVec* grown = new ChunkVec(*chunks);
+    grown->reserve(std::max(needed, chunks->size() * 2));
+    while (grown->size() < needed) {
+        AtomicGeneration* chunk = new AtomicGeneration[kChunkSize];
+        for (uint i = 0; i < kChunkSize; ++i) {
+            chunk[i].store(1 | kFreeBit, std::memory_order_relaxed); // еще не выданный идентификатор свободен
+        }
+        grown->push_back(chunk);
+    }
+    oldChunkVecs_.push_back(chunks);
+    chunks_.store(grown, std::memory_order_release);
+    num_.store(uig_.Num(), std::memory_order_release);
+}
+
+void ConcurrentUniqIntGenerator::TakeFromPool(uint n, uint* out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uig_.GetRange(n, out);
+    GrowGenerations();
+}
+
+uint ConcurrentUniqIntGenerator::PutToPool(const uint* first, const uint* last) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return uig_.PutMany(first, last);
+}
+
+uint ConcurrentUniqIntGenerator::Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint n = uig_.Get();
+    GrowGenerations();
+    MarkUsed(n);
+    return n;
+}
+
+bool ConcurrentUniqIntGenerator::Put(uint n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (n >= uig_.Num()) {
+#ifdef YADSL_USE_WXDEBUG
+        wxFAIL_MSG(wxT("out of range"));
+#endif
+        return false;
+    }
+    // свободный идентификатор может лежать в кэше потока, где пул его не видит
+    if (IsFree(n) || !uig_.Put(n)) {
+#ifdef YADSL_USE_WXDEBUG
+        wxFAIL_MSG(wxT("duplicate inserting detected"));
+#endif
+        return false;
+    }
+    MarkFree(n); // отвергнутый повторный возврат не меняет поколение
+    return true;
+}
+
+void ConcurrentUniqIntGenerator::GetRange(uint n, uint* out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uig_.GetRange(n, out);
+    GrowGenerations();
+    for (uint i = 0; i < n; ++i) {
+        MarkUsed(out[i]);
+    }
+}
+
+uint ConcurrentUniqIntGenerator::PutMany(const uint* first, const uint* last) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // в пул идут только выданные идентификаторы, каждый один раз; поколения увеличиваются у реально возвращенных
+    putBuf_.clear();
+    const uint num = uig_.Num();
+    for (const uint* p = first; p != last; ++p) {
+        if (*p < num && !IsFree(*p)) putBuf_.push_back(*p);
+    }
+    std::sort(putBuf_.begin(), putBuf_.end());
+    putBuf_.erase(std::unique(putBuf_.begin(), putBuf_.end()), putBuf_.end());
+    uint count = 0;
+    if (!putBuf_.empty()) {
+        count = uig_.PutMany(&putBuf_[0], &putBuf_[0] + putBuf_.size(), &putBuf_[0]);
+        for (uint i = 0; i < count; ++i) {
+            MarkFree(putBuf_[i]);
+        }
+    }
+#ifdef YADSL_USE_WXDEBUG
+    wxASSERT_MSG(count == uint(last - first), wxT("duplicate inserting detected"));
+#endif
+    return count;
+}
+
+uint ConcurrentUniqIntGenerator::Unused() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return uig_.Unused();
+}
+
+uint ConcurrentUniqIntGenerator::Num() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return uig_.Num();
+}
+
+//-----------------------------------------------------------------------------
+
+ConcurrentUniqIntGenerator::LocalCache::LocalCache(ConcurrentUniqIntGenerator& owner) : owner_(owner) {
+    ids_.reserve(2 * owner_.batch_);
+}
+
+ConcurrentUniqIntGenerator::LocalCache::~LocalCache() {
+    Flush();
+}
+
+void ConcurrentUniqIntGenerator::LocalCache::Refill() {
+    ids_.resize(owner_.batch_);
+    owner_.TakeFromPool(owner_.batch_, &ids_[0]);
+    std::reverse(ids_.begin(), ids_.end()); // наименьшие выдаются первыми
+}
+
+void ConcurrentUniqIntGenerator::LocalCache::Drain() {
+    // в пул уходят самые давние идентификаторы, недавние (горячие) остаются в кэше
+    owner_.PutToPool(&ids_[0], &ids_[0] + owner_.batch_);
+    ids_.erase(ids_.begin(), ids_.begin() + owner_.batch_);
+}
+
+bool ConcurrentUniqIntGenerator::LocalCache::PutHandle(Handle h) {
+    if (!owner_.IsAlive(h)) {
+#ifdef YADSL_USE_WXDEBUG
+        wxFAIL_MSG(wxT("stale handle"));
+#endif
+        return false;
+    }
+    return Put(UniqIntGenerator::HandleIndex(h));
+}
+
+void ConcurrentUniqIntGenerator::LocalCache::Flush() {
+    if (ids_.empty()) return;
+    owner_.PutToPool(&ids_[0], &ids_[0] + ids_.size());
+    ids_.clear();
+}
+
+} // end of yadsl
+
+
+//-----------------------------------------------------------------------------
+
+#if 0 // code for benchmark
+#include <stdio.h> // printf()
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "ConcUniqIntGen.h"
+
+using yadsl::uint;
+
+const uint kOpsPerThread = 4000000;
+const uint kLiveIds = 256; // число идентификаторов, которые поток держит одновременно
+
+// Каждый поток держит kLiveIds идентификаторов и по кругу возвращает и получает их заново
+template <typename Gen>
+void Worker(Gen& gen) {
+    uint ids[kLiveIds];
+    for (uint i = 0; i < kLiveIds; i++) ids[i] = gen.Get();
+    for (uint i = 0; i < kOpsPerThread; i++) {
+        uint slot = i % kLiveIds;
+        gen.Put(ids[slot]);
+        ids[slot] = gen.Get();
+    }
+    for (uint i = 0; i < kLiveIds; i++) gen.Put(ids[i]);
+}
+
+struct CachedWorker {
+    yadsl::ConcurrentUniqIntGenerator& uig_;
+    void operator()() {
+        yadsl::ConcurrentUniqIntGenerator::LocalCache cache(uig_);
+        Worker(cache);
+    }
+};
+
+struct LockedWorker {
+    yadsl::ConcurrentUniqIntGenerator& uig_;
+    void operator()() { Worker(uig_); }
+};
+
+template <typename W>
+double Run(uint cThreads) {
+    yadsl::ConcurrentUniqIntGenerator uig;
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint i = 0; i < cThreads; i++) {
+        W w = { uig };
+        threads.push_back(std::thread(w));
+    }
+    for (uint i = 0; i < cThreads; i++) threads[i].join();
+    std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+    return 2.0 * kOpsPerThread * cThreads / sec.count() / 1e6; // миллионов Get+Put в секунду
+}
+
+int main() {
+    printf("threads | locked Mops/s | cached Mops/s\n");
+    for (uint cThreads = 1; cThreads <= std::thread::hardware_concurrency(); cThreads *= 2) {
+        printf("%7d | %13.1f | %13.1f\n", cThreads, Run<LockedWorker>(cThreads), Run<CachedWorker>(cThreads));
+    }
+}
+
+#endif
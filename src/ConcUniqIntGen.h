@@ -0,0 +1,196 @@
+#ifndef YADSL_CONCUNIQINTGEN_H
+#define YADSL_CONCUNIQINTGEN_H
+
+/** @file ConcUniqIntGen.h.
+
+Назначение: генератор уникальных целочисленных идентификаторов, разделяемый между потоками.
+*/
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "BaseTypes.h"
+#include "UniqIntGen.h"
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+namespace yadsl
+{
+
+/** @brief Потокобезопасный генератор уникальных целочисленных идентификаторов с кэшами потоков.
+
+Общий пул идентификаторов (UniqIntGenerator) защищен мьютексом. Каждый рабочий поток заводит свой кэш
+LocalCache: кэш берет идентификаторы из пула пачками по BatchSize() и возвращает излишки тоже пачками,
+поэтому в типичном случае Get() и Put() кэша обходятся без блокировок и атомарных read-modify-write операций.
+Методы Get() и Put() самого генератора работают с пулом напрямую под мьютексом.
+
+Как и UniqIntGenerator с поколениями, генератор выдает дескрипторы {индекс, поколение} и проверяет их
+через IsAlive() из любого потока. Поколения хранятся в кусках фиксированного размера, которые никогда
+не перемещаются в памяти, поэтому чтение не требует блокировок. Рядом с поколением хранится признак того,
+что идентификатор свободен (лежит в кэше потока или в общем пуле): по нему любой Put() за O(1) и без блокировок
+отвергает повторный возврат идентификатора, где бы тот ни находился.
+
+Пример:
+@code
+ConcurrentUniqIntGenerator uig;
+// в каждом рабочем потоке
+ConcurrentUniqIntGenerator::LocalCache cache(uig);
+uint n = cache.Get();
+//...
+cache.Put(n);
+@endcode
+
+@note идентификаторы, лежащие в кэшах потоков, не учитываются в Unused(). Одновременный возврат одного
+и того же идентификатора из разных потоков - ошибка вызывающего кода и не обнаруживается.
+*/
+class ConcurrentUniqIntGenerator {
+public:
+    typedef UniqIntGenerator::Handle Handle;
+
+    /** @brief Кэш идентификаторов одного потока.
+    Экземпляр должен использоваться только создавшим его потоком и уничтожаться раньше генератора.
+    При уничтожении все идентификаторы кэша возвращаются в генератор.
+    */
+    class LocalCache {
+    private:
+        ConcurrentUniqIntGenerator& owner_;
+        std::vector<uint> ids_; // идентификаторы кэша, наименьшие - в конце
+
+        void Refill();
+        void Drain();
+
+        LocalCache(const LocalCache&);
+        LocalCache& operator=(const LocalCache&);
+
+    public:
+        explicit LocalCache(ConcurrentUniqIntGenerator& owner);
+        ~LocalCache();
+
+        /// Получить уникальный или неиспользуемый идентификатор
+        uint Get() {
+            if (ids_.empty()) Refill();
+            uint n = ids_.back();
+            ids_.pop_back();
+            owner_.MarkUsed(n);
+            return n;
+        }
+
+        /** @brief Положить неиспользуемый идентификатор в кэш.
+        @return false, если идентификатор не генерировался или уже свободен (повторный возврат).
+        */
+        bool Put(uint n) {
+            if (n >= owner_.num_.load(std::memory_order_acquire)) {
+#ifdef YADSL_USE_WXDEBUG
+                wxFAIL_MSG(wxT("out of range"));
+#endif
+                return false;
+            }
+            if (!owner_.MarkFree(n)) {
+#ifdef YADSL_USE_WXDEBUG
+                wxFAIL_MSG(wxT("duplicate inserting detected"));
+#endif
+                return false;
+            }
+            ids_.push_back(n);
+            if (ids_.size() >= 2 * owner_.batch_) Drain();
+            return true;
+        }
+
+        /// Получить дескриптор нового уникального или неиспользуемого идентификатора
+        Handle GetHandle() {
+            uint n = Get();
+            return UniqIntGenerator::MakeHandle(n, owner_.Generation(n));
+        }
+
+        /** @brief Вернуть идентификатор дескриптора в кэш.
+        @return false, если дескриптор устарел.
+        */
+        bool PutHandle(Handle h);
+
+        /// Вернуть все идентификаторы кэша в генератор
+        void Flush();
+    };
+
+private:
+    enum { kChunkShift = 12, kChunkSize = 1 << kChunkShift, kChunkMask = kChunkSize - 1 };
+    static const uint kFreeBit = 0x80000000u; // признак свободного идентификатора в слове поколения
+    typedef std::atomic<uint> AtomicGeneration;
+    typedef std::vector<AtomicGeneration*> ChunkVec;
+
+    std::mutex mutex_;              // защищает uig_ и изменение каталога поколений
+    UniqIntGenerator uig_;          // общий пул идентификаторов
+    const uint batch_;              // размер пачки обмена между кэшем потока и пулом
+    std::atomic<const ChunkVec*> chunks_; // каталог кусков поколений, заменяется целиком при росте
+    std::vector<const ChunkVec*> oldChunkVecs_; // прежние каталоги (читатели могут еще ими пользоваться)
+    std::atomic<uint> num_;         // копия uig_.Num() для проверки идентификаторов без мьютекса
+    std::vector<uint> putBuf_;      // буфер PutMany() (под мьютексом)
+
+    // Завести куски поколений для всех сгенерированных идентификаторов (под мьютексом)
+    void GrowGenerations();
+    // Взять пачку идентификаторов для кэша потока: они остаются свободными до выдачи из кэша
+    void TakeFromPool(uint n, uint* out);
+    // Вернуть пачку идентификаторов в общий пул, они уже помечены свободными
+    uint PutToPool(const uint* first, const uint* last);
+    AtomicGeneration& GenerationOf(uint n) const {
+        const ChunkVec& chunks = *chunks_.load(std::memory_order_acquire);
+        return chunks[n >> kChunkShift][n & kChunkMask];
+    }
+    uint Generation(uint n) const { return GenerationOf(n).load(std::memory_order_relaxed) & ~kFreeBit; }
+    bool IsFree(uint n) const { return (GenerationOf(n).load(std::memory_order_relaxed) & kFreeBit) != 0; }
+    // Идентификатор выдан: снять признак свободного
+    void MarkUsed(uint n) {
+        AtomicGeneration& gen = GenerationOf(n);
+        gen.store(gen.load(std::memory_order_relaxed) & ~kFreeBit, std::memory_order_relaxed);
+    }
+    /* Идентификатор возвращен: увеличить поколение и пометить свободным, false - он уже свободен.
+    Идентификатор принадлежит вызывающему потоку, поэтому хватает записи без RMW.
+    */
+    bool MarkFree(uint n) {
+        AtomicGeneration& gen = GenerationOf(n);
+        uint cur = gen.load(std::memory_order_relaxed);
+        if (cur & kFreeBit) return false;
+        uint next = (cur + 1) & ~kFreeBit;
+        gen.store((next == 0 ? 1 : next) | kFreeBit, std::memory_order_relaxed);
+        return true;
+    }
+
+    ConcurrentUniqIntGenerator(const ConcurrentUniqIntGenerator&);
+    ConcurrentUniqIntGenerator& operator=(const ConcurrentUniqIntGenerator&);
+
+public:
+    explicit ConcurrentUniqIntGenerator(uint batchSize = 64);
+    ~ConcurrentUniqIntGenerator();
+
+    /// Размер пачки обмена между кэшем потока и общим пулом
+    uint BatchSize() const { return batch_; }
+
+    /// Получить новый уникальный или неиспользуемый идентификатор из общего пула (под мьютексом)
+    uint Get();
+    /// Положить неиспользуемый идентификатор в общий пул (под мьютексом)
+    bool Put(uint n);
+    /// Получить n идентификаторов из общего пула (@see UniqIntGenerator::GetRange)
+    void GetRange(uint n, uint* out);
+    /** @brief Положить пачку идентификаторов в общий пул (@see UniqIntGenerator::PutMany).
+    Ошибочные, повторные и уже свободные идентификаторы пропускаются, их поколения не меняются.
+    */
+    uint PutMany(const uint* first, const uint* last);
+
+    /// Проверка, что идентификатор дескриптора не возвращался после выдачи дескриптора. Можно вызывать из любого потока.
+    bool IsAlive(Handle h) const {
+        uint index = UniqIntGenerator::HandleIndex(h);
+        const ChunkVec& chunks = *chunks_.load(std::memory_order_acquire);
+        if ((index >> kChunkShift) >= chunks.size()) return false;
+        // у свободного идентификатора установлен kFreeBit, и сравнение с любым поколением дескриптора неверно
+        return chunks[index >> kChunkShift][index & kChunkMask].load(std::memory_order_relaxed) == UniqIntGenerator::HandleGeneration(h);
+    }
+
+    /// Число неиспользуемых идентификаторов в общем пуле (без кэшей потоков)
+    uint Unused();
+    /// Число сгенерированных идентификаторов
+    uint Num();
+};
+
+} // end of yadsl
+
+#endif // YADSL_CONCUNIQINTGEN_H
@@ -13,9 +13,14 @@
 
 
 #ifdef YADSL_USE_OWNLIST_IN_ENTITY
+#ifdef YADSL_USE_UNROLLED_OWNLIST
+#include "UnrolledList.h"
+#else
 #include "List.h"
+#endif
 #else
 #include <list>
+#include "StlListAlloc.h"
 #endif
 
 /** @file EC_Manager.h.
@@ -46,11 +51,24 @@ class Ec_Manager {
         T* component_;
     };
 
+    // Сущность-владелец экземпляра компоненты, для исправления указателей при уплотнении пула
+    struct OwnerRef {
+        PEntity entity_;
+        uint componentIndex_;
+    };
+
 public:
 #ifdef YADSL_USE_OWNLIST_IN_ENTITY
+#ifdef YADSL_USE_UNROLLED_OWNLIST
+    // несколько владельцев в узле: обход списка владельцев дает промах кэша на узел, а не на каждого владельца
+    typedef UnrolledList<PEntity, kPOD_LIST> EntityAccessPoints;
+    typedef EntityAccessPoints::Handle EntityAccessPointPos;
+#else
     typedef List<PEntity, kPOD_LIST> EntityAccessPoints;
+    typedef EntityAccessPoints::Node* EntityAccessPointPos;
+#endif
 #else
-    typedef std::list<PEntity, ListAllocator<PEntity >> EntityAccessPoints;
+    typedef std::list<PEntity, StlListAllocator<PEntity> > EntityAccessPoints;
 #endif
 
 
@@ -60,9 +78,16 @@ private: // vars
     // пул блоков памяти для размещения компоненты
     ClassInstanceMemBlockPool<T>* memPool_;
 
+#ifdef YADSL_USE_OWNLIST_IN_ENTITY
+    // общий пул узлов всех списков owners_ (объявлен раньше них, поэтому переживает их)
+    typename EntityAccessPoints::Pool ownersPool_;
+#endif
     // контейнер точек доступа к экземплярам сущностей, которые содержат данную компоненту
     EntityAccessPoints owners_[N];
 
+    // владельцы экземпляров по идентификаторам их блоков (@see ClassInstanceMemBlockPool::BlockId())
+    std::vector<OwnerRef> ownerRefs_;
+
     CachePair cache_[kCacheCap]; // кэш для доступа к компонентам сущностей, с которыми работали в прошлый раз
     uint cacheIndex_; // индекс в кэше, куда будет записана очередная пара указателей
 
@@ -106,7 +131,12 @@ private: // methods
         wxASSERT(componentIndex < uint(N));
 #endif
 #ifdef YADSL_USE_OWNLIST_IN_ENTITY
-        EntityAccessPoints::Node* ownerPos = owners_[componentIndex].push_back(entity);
+#ifdef YADSL_USE_UNROLLED_OWNLIST
+        // порядок владельцев не важен: занимается ячейка, освобожденная прежним удалением, и узлы не редеют
+        EntityAccessPointPos ownerPos = owners_[componentIndex].push_any(entity);
+#else
+        EntityAccessPointPos ownerPos = owners_[componentIndex].push_back(entity);
+#endif
         entity->SetComponentOwnerPos(GetComponentId(), componentIndex, ownerPos);
 #else
         owners_[componentIndex].push_back(entity);
@@ -126,7 +156,7 @@ private: // methods
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT(p != 0);
 #endif
-        EntityAccessPoints::Node* ownerPos = reinterpret_cast<EntityAccessPoints::Node*>(p);
+        EntityAccessPointPos ownerPos = reinterpret_cast<EntityAccessPointPos>(p);
         owners_[componentIndex].erase(ownerPos);
         entity->SetComponentOwnerPos(GetComponentId(), componentIndex, ownerPos);
 #else
@@ -134,12 +164,27 @@ private: // methods
 #endif
     }
 
+    // Запомнить владельца экземпляра в блоке p
+    void SetOwnerRef(void* p, PEntity entity, uint componentIndex) {
+        uint id = memPool_->BlockId(p);
+        if (id >= ownerRefs_.size()) {
+            ownerRefs_.resize(id + 1);
+        }
+        ownerRefs_[id].entity_ = entity;
+        ownerRefs_[id].componentIndex_ = componentIndex;
+    }
+
 public:
     Ec_Manager() : cacheIndex_(0) {
         id_ = Entity::GenerateComponentId();
         if (NeedMem()) {
             memPool_ =  new ClassInstanceMemBlockPool <T>;
         }
+#ifdef YADSL_USE_OWNLIST_IN_ENTITY
+        for (uint i = 0; i < (uint)N; i++) {
+            owners_[i] = EntityAccessPoints(ownersPool_);
+        }
+#endif
     }
 
     ~Ec_Manager() {
@@ -242,11 +287,42 @@ public:
         void* p = 0;
         p = memPool_->Alloc();
         if (p == 0) return false;
+        if (!NeedOutCtorCall()) {
+            memPool_->MarkAsConstructed(p); // POD готова к использованию сразу, метка нужна для обхода ForEachComponent()
+        }
         entity->SetOrInsertComponent(GetComponentId(), componentIndex, p);
+        SetOwnerRef(p, entity, componentIndex);
         AddEntityAccessPoint(entity, componentIndex);
         return true;
     }
 
+    /** @brief Добавление в сущность экземпляра компоненты-класса, сконструированного с заданными аргументами.
+
+    Заменяет последовательность AddComponentTo(), GetComponentMem(), размещающий new и MarkComponentAsConstructed():
+    @code
+    weaponDataEcMng.EmplaceComponentTo(shotgun, 0, 12, "shotgun.dat");
+    @endcode
+
+    @param entity - указатель на сущность.
+    @param componentIndex - индекс компоненты среди компонент такого же типа.
+    @param args - аргументы конструктора компоненты.
+    @return указатель на компоненту или 0 при нехватке памяти.
+    */
+    template <typename... A>
+    T* EmplaceComponentTo(Entity* entity, uint componentIndex, A&&... args) {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT_MSG(NeedOutCtorCall(), wxT("Operation is not allowed for this component kind"));
+        wxASSERT(entity != 0);
+        wxASSERT_MSG(!FindComponent(entity, componentIndex), wxT("avoid double component adding"));
+#endif
+        T* component = memPool_->Construct(std::forward<A>(args)...);
+        if (component == 0) return 0;
+        entity->SetOrInsertComponent(GetComponentId(), componentIndex, component);
+        SetOwnerRef(component, entity, componentIndex);
+        AddEntityAccessPoint(entity, componentIndex);
+        return component;
+    }
+
     /** @brief Удалить экземпляр компоненты с заданным индексом из данных сущности.
     @param entity - указатель на сущность.
     @param componentIndex - индекс компоненты среди компонент такого же типа. По умолчанию равен 0.
@@ -263,16 +339,18 @@ public:
         wxASSERT(fHasComponent);
         wxASSERT(p != 0);
 #endif
+        ownerRefs_[memPool_->BlockId(p)].entity_ = 0;
         if (NeedOutCtorCall()) {
             T* instance = ConvertToComponentType(p);
 #ifdef YADSL_USE_WXDEBUG
             wxASSERT(instance != 0);
 #endif
-            instance->~T();
+            memPool_->Destroy(instance);
+        }
+        else {
             memPool_->MarkAsDestructed(p);
+            memPool_->Free(p);
         }
-
-        memPool_->Free(p);
         RemoveEntityAccessPoint(entity, componentIndex);
         //entity->SetOrInsertComponent(GetComponentId(), componentIndex, 0);
         entity->EraseComponent(GetComponentId(), componentIndex);
@@ -361,6 +439,54 @@ public:
         return memPool_->MarkedAsConstructed(p);
     }
 
+    /** @brief Обойти все экземпляры компоненты в порядке их размещения в памяти.
+
+    В отличие от обхода обладателей (GetOwners()) с поиском компоненты в каждой сущности, экземпляры читаются
+    из пула подряд. Компоненты-классы, которые еще не сконструированы (@see MarkComponentAsConstructed()), пропускаются.
+    @code
+    weaponDataEcMng.ForEachComponent([](WeaponData* w) { w->ammo_ = 0; });
+    @endcode
+    @param fn функтор с оператором void operator()(T*). Не должен добавлять и удалять компоненты этого типа.
+    */
+    template <typename F>
+    void ForEachComponent(F&& fn) {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT_MSG(NeedMem(), wxT("Operation is not allowed for this component kind"));
+#endif
+        memPool_->ForEachLive(std::forward<F>(fn));
+    }
+
+    /** @brief Уплотнить память экземпляров компоненты, переместив не больше budget экземпляров (@see ClassInstanceMemBlockPool::Compact()).
+
+    Указатели на память компоненты в сущностях исправляются автоматически: владелец перемещаемого экземпляра
+    берется за O(1) из таблицы владельцев по идентификатору блока. Указатели на компоненты, полученные ранее через
+    GetComponentOf() и GetComponentMem(), после уплотнения недействительны. Компоненты-классы должны иметь конструктор перемещения
+    или копирования, несконструированные компоненты-классы не перемещаются.
+    @code
+    weaponDataEcMng.Compact(128); // раз в кадр
+    @endcode
+    @return число перемещенных экземпляров.
+    */
+    uint Compact(uint budget) {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT_MSG(NeedMem(), wxT("Operation is not allowed for this component kind"));
+#endif
+        return memPool_->Compact(budget, [this](T* from, T* to) {
+            OwnerRef ref = ownerRefs_[memPool_->BlockId(from)];
+#ifdef YADSL_USE_WXDEBUG
+            wxASSERT(ref.entity_ != 0);
+#endif
+            ownerRefs_[memPool_->BlockId(from)].entity_ = 0;
+            ref.entity_->SetOrInsertComponent(GetComponentId(), ref.componentIndex_, to);
+            SetOwnerRef(to, ref.entity_, ref.componentIndex_);
+            for (uint i = 0; i < kCacheCap; i++) {
+                if (cache_[i].component_ == from) {
+                    cache_[i].entity_ = 0;
+                }
+            }
+        });
+    }
+
     /** @brief Возвращает вектор указателей обладателей данной компоненты. */
     EntityAccessPoints& GetOwners(uint componentIndex = 0) {
 #ifdef YADSL_USE_WXDEBUG
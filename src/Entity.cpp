@@ -3,13 +3,20 @@
 #ifdef YADSL_USE_WXDEBUG
 #include <wx/wx.h>
 #endif
-#include "UniqIntGen.h"
+#ifdef YADSL_USE_CONCURRENT_UIG_IN_ENTITY
+#include "ConcUniqIntGen.h"
+#endif
 
 namespace yadsl
 {
 
 const uint Entity::kComponentIdNotAssigned_ = 0;
-static UniqIntGenerator s_uig; // генератор уникальных целочисленных идентификаторов
+#ifdef YADSL_USE_CONCURRENT_UIG_IN_ENTITY
+static ConcurrentUniqIntGenerator s_uig; // генератор уникальных целочисленных идентификаторов, общий для всех потоков
+static thread_local ConcurrentUniqIntGenerator::LocalCache s_localUig(s_uig); // кэш идентификаторов потока
+#else
+static UniqIntGenerator s_uig(true); // генератор уникальных целочисленных идентификаторов (с поколениями)
+#endif
 
 uint Entity::GenerateComponentId() {
     static uint count = kComponentIdNotAssigned_;
@@ -17,12 +24,24 @@ uint Entity::GenerateComponentId() {
 }
 
 Entity::Entity() {
-    id_ = s_uig.Get();
-
+#ifdef YADSL_USE_CONCURRENT_UIG_IN_ENTITY
+    handle_ = s_localUig.GetHandle();
+#else
+    handle_ = s_uig.GetHandle();
+#endif
+    id_ = UniqIntGenerator::HandleIndex(handle_);
 }
 
 Entity::~Entity() {
-    s_uig.Put(id_);
+#ifdef YADSL_USE_CONCURRENT_UIG_IN_ENTITY
+    s_localUig.PutHandle(handle_);
+#else
+    s_uig.PutHandle(handle_);
+#endif
+}
+
+bool Entity::IsAlive(Handle handle) {
+    return s_uig.IsAlive(handle);
 }
 
 #ifdef YADSL_USE_IDVALUEVECTOR_IN_ENTITY
@@ -43,10 +62,7 @@ bool Entity::FindComponent(ComponentMap::iterator& it, const ComponentItem** ppI
         const ComponentItem& startItem = start->GetValue();
         if (startItem.index_ == componentIndex) {
             it = start;
-#ifdef YADSL_USE_WXDEBUG
-            wxASSERT(ppItem != 0);
-#endif
-            *ppItem = &startItem;
+            if (ppItem != 0) *ppItem = &startItem;
             fFound = true;
             break;
         }
@@ -63,10 +79,7 @@ bool Entity::FindComponent(ComponentMap::iterator& it, const ComponentItem** ppI
         ComponentItem& startItem = start->second;
         if (startItem.index_ == componentIndex) {
             it = start;
-#ifdef YADSL_USE_WXDEBUG
-            wxASSERT(ppItem != 0);
-#endif
-            *ppItem = &startItem;
+            if (ppItem != 0) *ppItem = &startItem;
             fFound = true;
             break;
         }
@@ -107,7 +120,7 @@ bool Entity::SetOrInsertComponent(uint componentId, uint componentIndex, void* c
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT (start != componentMap_.EndIterator());
 #endif
-        start->SetValue(ComponentItem (componentIndex, componentMem));
+        start->GetValue().mem_ = componentMem; // позиция в контейнере владельцев сохраняется
     }
 #else
     ComponentMap::iterator start;
@@ -11,7 +11,9 @@
 #else
 #include <map>
 #include "BaseTypes.h"
+#include "StlListAlloc.h"
 #endif
+#include "UniqIntGen.h"
 
 
 
@@ -27,7 +29,9 @@ EC - Entity Component
 
 ###Сборка###
 Макрос YADSL_USE_IDVALUEVECTOR_IN_ENTITY отвечает за реализацию на основе IdValueMultiVector. Без установки
-этого макроса класс будет собран на основе std::map.
+этого макроса класс будет собран на основе std::multimap, узлы которого выделяются из кэша StlListAllocator.
+Макрос YADSL_USE_CONCURRENT_UIG_IN_ENTITY позволяет создавать и уничтожать сущности из нескольких потоков:
+идентификаторы берутся из общего ConcurrentUniqIntGenerator через кэш каждого потока.
 
 */
 class Entity {
@@ -35,6 +39,8 @@ public:
     static const uint kComponentIdNotAssigned_; // недопустимое значение идентификатора компоненты сущности - число, обозначающее, что идентификатор не назначен
 
     typedef void* PVoid;
+    /// Дескриптор сущности: идентификатор и его поколение (@see UniqIntGenerator::Handle)
+    typedef UniqIntGenerator::Handle Handle;
 
 
     struct ComponentItem {
@@ -50,12 +56,13 @@ public:
 #ifdef YADSL_USE_IDVALUEVECTOR_IN_ENTITY
     typedef IdValueMultiVector<ComponentItem> ComponentMap;
 #else
-    typedef std::multimap<uint, ComponentItem> ComponentMap;
+    typedef std::multimap<uint, ComponentItem, std::less<uint>, StlListAllocator<std::pair<const uint, ComponentItem> > > ComponentMap;
 #endif
 
 
 private:
     int id_; // идентификатор сущности
+    Handle handle_; // дескриптор сущности
     ComponentMap componentMap_;     // словарь доступа к составляющим частям (компонентам)
 
     /** @brief Поиск компоненты среди данных сущности.
@@ -86,6 +93,16 @@ public:
     /// Получить идентификатор экземпляра этой сущности
     int GetId() const { return id_; }
 
+    /** @brief Получить дескриптор экземпляра этой сущности.
+    Дескриптор можно хранить вместо указателя на сущность и проверять через IsAlive() без поиска в словарях.
+    */
+    Handle GetHandle() const { return handle_; }
+
+    /** @brief Проверка за O(1), что сущность с заданным дескриптором еще существует.
+    Идентификатор уничтоженной сущности может быть выдан новой сущности, но дескриптор старой останется недействительным.
+    */
+    static bool IsAlive(Handle handle);
+
     /** @brief Проверка наличия компоненты среди данных сущности.
     @param componentId - идентификатор компоненты.
     @param componentIndex - индекс компоненты среди компонент такого же типа. Передать kNoIndex, если индекс не важен, а важен только факт наличия компоненты вообще.
@@ -0,0 +1,201 @@
+#ifndef YADSL_INTBITMAPSET_H
+#define YADSL_INTBITMAPSET_H
+
+/** @file IntBitmapSet.h.
+
+Назначение: множество целых чисел в виде многоуровневой битовой карты.
+*/
+
+#include <vector>
+#include "BaseTypes.h"
+#include "Utils.h"
+
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+namespace yadsl
+{
+
+/** @brief Множество целых чисел в виде многоуровневой битовой карты из 64-битных слов.
+
+Уровень 0 хранит по биту на число. Бит j уровня k + 1 установлен, если слово j уровня k не нулевое.
+Верхний уровень всегда состоит из одного слова. Поиск наименьшего числа - спуск сверху вниз по уровням
+с подсчетом младших нулевых бит (Ctz64) в каждом слове, то есть за число уровней (4 уровня на 16M чисел).
+
+Расход памяти - около одного бита на каждое число диапазона [0, max], что для миллионов идентификаторов
+в 32 раза меньше вектора uint. Используется генератором UniqIntGenerator при сборке с макросом
+YADSL_USE_BITMAP_IN_UNIQINTGENERATOR.
+*/
+class IntBitmapSet {
+private:
+    enum { kWordBits = 64, kWordShift = 6, kWordMask = 63 };
+    typedef std::vector<uint64_t> WordVec;
+
+    std::vector<WordVec> levels_;   // уровни карты, levels_[0] - биты чисел
+    uint size_;                     // число чисел во множестве
+
+    uint Capacity() const { return levels_.empty() ? 0 : levels_[0].size() * kWordBits; }
+
+    // Расширить карту так, чтобы в нее помещалось число n
+    void Grow(uint n) {
+        size_t words = levels_.empty() ? 1 : levels_[0].size() * 2;
+        if (words <= (n >> kWordShift)) words = (n >> kWordShift) + 1;
+        for (size_t k = 0; ; ++k) {
+            if (k == levels_.size()) {
+                levels_.push_back(WordVec(words, 0));
+                if (k > 0) {
+                    // новый уровень строится по заполненности слов предыдущего
+                    const WordVec& below = levels_[k - 1];
+                    for (size_t i = 0; i < below.size(); ++i) {
+                        if (below[i] != 0) levels_[k][i >> kWordShift] |= uint64_t(1) << (i & kWordMask);
+                    }
+                }
+            }
+            else {
+                levels_[k].resize(words, 0);
+            }
+            if (words == 1) break;
+            words = (words + kWordMask) >> kWordShift;
+        }
+    }
+
+public:
+    IntBitmapSet() : size_(0) {}
+
+    /// Пусто ли множество
+    bool Empty() const { return size_ == 0; }
+    /// Число чисел во множестве
+    uint Size() const { return size_; }
+
+    /// Содержит ли множество заданное число
+    bool Contains(uint n) const {
+        if (n >= Capacity()) return false;
+        return (levels_[0][n >> kWordShift] >> (n & kWordMask)) & 1;
+    }
+
+    /** @brief Вставить число.
+    @return false, если число уже есть во множестве.
+    */
+    bool Insert(uint n) {
+        if (n >= Capacity()) Grow(n);
+        for (size_t k = 0; k < levels_.size(); ++k) {
+            uint64_t& word = levels_[k][n >> kWordShift];
+            uint64_t bit = uint64_t(1) << (n & kWordMask);
+            if (k == 0 && (word & bit) != 0) return false;
+            bool fWasEmpty = (word == 0);
+            word |= bit;
+            if (!fWasEmpty) break; // выше слово уже помечено как непустое
+            n >>= kWordShift;
+        }
+        ++size_;
+        return true;
+    }
+
+    /** @brief Извлечь наименьшее число.
+    @note множество не должно быть пустым.
+    */
+    uint PopLowest() {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(!Empty());
+#endif
+        uint n = 0;
+        for (size_t k = levels_.size(); k-- > 0; ) {
+            n = (n << kWordShift) + Ctz64(levels_[k][n]);
+        }
+        uint m = n;
+        for (size_t k = 0; k < levels_.size(); ++k) {
+            uint64_t& word = levels_[k][m >> kWordShift];
+            word &= ~(uint64_t(1) << (m & kWordMask));
+            if (word != 0) break; // слово осталось непустым, выше ничего не меняется
+            m >>= kWordShift;
+        }
+        --size_;
+        return n;
+    }
+
+    /** @brief Извлечь до n наименьших чисел.
+
+    Числа забираются целыми словами: спуск по уровням выполняется один раз на каждое слово уровня 0.
+    @param out [out] массив, куда записываются извлеченные числа по возрастанию.
+    @return число извлеченных чисел.
+    */
+    uint PopLowest(uint* out, uint n) {
+        uint count = 0;
+        while (count < n && !Empty()) {
+            uint w = 0;
+            for (size_t k = levels_.size(); k-- > 1; ) {
+                w = (w << kWordShift) + Ctz64(levels_[k][w]);
+            }
+            uint64_t& word = levels_[0][w];
+            while (word != 0 && count < n) {
+                out[count++] = (w << kWordShift) + Ctz64(word);
+                word &= word - 1;
+                --size_;
+            }
+            for (size_t k = 1; k < levels_.size() && levels_[k - 1][w] == 0; ++k) {
+                levels_[k][w >> kWordShift] &= ~(uint64_t(1) << (w & kWordMask));
+                w >>= kWordShift;
+            }
+        }
+        return count;
+    }
+
+    /** @brief Вставить упорядоченную по возрастанию последовательность чисел [first, last).
+
+    Карта расширяется один раз, соседние числа попадают в одни и те же слова.
+    @param inserted [out] если не 0 - сюда по возрастанию записываются вставленные числа (может совпадать с first).
+    @return число вставленных чисел (повторы и уже имеющиеся числа пропускаются).
+    */
+    uint InsertSorted(const uint* first, const uint* last, uint* inserted = 0) {
+        if (first == last) return 0;
+        if (*(last - 1) >= Capacity()) Grow(*(last - 1));
+        uint count = 0;
+        for (; first != last; ++first) {
+            if (Insert(*first)) {
+                if (inserted != 0) inserted[count] = *first;
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    /// Возвращает true, если множество пусто или состоит ровно из чисел 0, 1, ..., Size() - 1
+    bool IsPrefix() const {
+        const uint fullWords = size_ >> kWordShift;
+        for (uint i = 0; i < fullWords; ++i) {
+            if (levels_[0][i] != ~uint64_t(0)) return false;
+        }
+        const uint rest = size_ & kWordMask;
+        return rest == 0 || levels_[0][fullWords] == (uint64_t(1) << rest) - 1;
+    }
+
+    /** @brief Обойти множество по отрезкам подряд идущих чисел.
+    @param fn функтор с оператором void operator()(uint lo, uint hi), отрезок [lo, hi).
+    */
+    template <typename F>
+    void ForEachRun(F& fn) const {
+        uint lo = kNoId;
+        const uint capacity = Capacity();
+        for (uint n = 0; n < capacity; ++n) {
+            if (Contains(n)) {
+                if (lo == kNoId) lo = n;
+            }
+            else if (lo != kNoId) {
+                fn(lo, n);
+                lo = kNoId;
+            }
+        }
+        if (lo != kNoId) fn(lo, capacity);
+    }
+
+    /// Удалить все числа
+    void Clear() {
+        levels_.clear();
+        size_ = 0;
+    }
+};
+
+} // end of yadsl
+
+#endif // YADSL_INTBITMAPSET_H
@@ -0,0 +1,202 @@
+#ifndef YADSL_INTRUNSET_H
+#define YADSL_INTRUNSET_H
+
+/** @file IntRunSet.h.
+
+Назначение: множество целых чисел, хранимое в виде непересекающихся отрезков [lo, hi).
+*/
+
+#include <map>
+#include "BaseTypes.h"
+
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+namespace yadsl
+{
+
+/** @brief Множество целых чисел в виде слитых отрезков [lo, hi).
+
+Соседние числа всегда сливаются в один отрезок, поэтому расход памяти зависит от числа отрезков,
+а не от числа хранимых чисел: множество {0, 1, ..., 99999} занимает один узел дерева.
+Отрезки хранятся в сбалансированном дереве (std::map), вставка, проверка и извлечение наименьшего
+числа выполняются за логарифмическое от числа отрезков время.
+
+Используется генератором UniqIntGenerator для хранения неиспользуемых идентификаторов.
+*/
+class IntRunSet {
+public:
+    /* Ключ - правая (не входящая в отрезок) граница hi, значение - левая граница lo.
+    При таком ключе извлечение наименьшего числа меняет только значение узла, а не ключ.
+    */
+    typedef std::map<uint, uint> RunMap;
+
+private:
+    RunMap runs_;   // отрезки, упорядоченные по правой границе
+    uint size_;     // число чисел во всех отрезках
+
+public:
+    IntRunSet() : size_(0) {}
+
+    /// Пусто ли множество
+    bool Empty() const { return size_ == 0; }
+    /// Число чисел во множестве
+    uint Size() const { return size_; }
+    /// Число отрезков, которыми представлено множество
+    uint RunNum() const { return runs_.size(); }
+
+    /// Содержит ли множество заданное число
+    bool Contains(uint n) const {
+        RunMap::const_iterator it = runs_.upper_bound(n);
+        return it != runs_.end() && it->second <= n;
+    }
+
+    /** @brief Вставить число.
+    @return false, если число уже есть во множестве.
+    */
+    bool Insert(uint n) {
+        RunMap::iterator next = runs_.upper_bound(n); // первый отрезок с hi > n
+        if (next != runs_.end() && next->second <= n) {
+            return false; // n уже внутри отрезка
+        }
+        bool fJoinNext = (next != runs_.end() && next->second == n + 1);
+        RunMap::iterator prev = runs_.end();
+        if (next != runs_.begin()) {
+            prev = next;
+            --prev;
+            if (prev->first != n) prev = runs_.end(); // предыдущий отрезок не примыкает к n
+        }
+
+        if (prev != runs_.end()) {
+            uint lo = prev->second;
+            runs_.erase(prev);
+            if (fJoinNext) {
+                next->second = lo;
+            }
+            else {
+                runs_.insert(next, RunMap::value_type(n + 1, lo));
+            }
+        }
+        else if (fJoinNext) {
+            next->second = n;
+        }
+        else {
+            runs_.insert(next, RunMap::value_type(n + 1, n));
+        }
+        ++size_;
+        return true;
+    }
+
+    /** @brief Извлечь наименьшее число.
+    @note множество не должно быть пустым.
+    */
+    uint PopLowest() {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(!Empty());
+#endif
+        RunMap::iterator first = runs_.begin();
+        uint n = first->second++;
+        if (first->second == first->first) {
+            runs_.erase(first);
+        }
+        --size_;
+        return n;
+    }
+
+    /** @brief Извлечь до n наименьших чисел.
+    @param out [out] массив, куда записываются извлеченные числа по возрастанию.
+    @return число извлеченных чисел.
+    */
+    uint PopLowest(uint* out, uint n) {
+        uint count = 0;
+        while (count < n && !runs_.empty()) {
+            RunMap::iterator first = runs_.begin();
+            while (count < n && first->second < first->first) {
+                out[count++] = first->second++;
+            }
+            if (first->second == first->first) {
+                runs_.erase(first);
+            }
+        }
+        size_ -= count;
+        return count;
+    }
+
+    /** @brief Вставить упорядоченную по возрастанию последовательность чисел [first, last).
+
+    Отрезки множества и вставляемые числа сливаются за один линейный проход, новое дерево строится
+    вставкой в конец. Для нескольких чисел в большое множество выгоднее поэлементная вставка, она и выполняется.
+    @param inserted [out] если не 0 - сюда по возрастанию записываются вставленные числа (может совпадать с first).
+    @return число вставленных чисел (повторы и уже имеющиеся числа пропускаются).
+    */
+    uint InsertSorted(const uint* first, const uint* last, uint* inserted = 0) {
+        if (std::size_t(last - first) * 16 < runs_.size()) {
+            uint count = 0;
+            for (; first != last; ++first) {
+                if (Insert(*first)) {
+                    if (inserted != 0) inserted[count] = *first;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        RunMap merged;
+        uint lo = 0, hi = 0; // накапливаемый отрезок [lo, hi), пуст при lo == hi
+        uint count = 0;
+        RunMap::const_iterator run = runs_.begin();
+        while (run != runs_.end() || first != last) {
+            uint nextLo, nextHi;
+            if (first != last && (run == runs_.end() || *first < run->second)) {
+                nextLo = *first++;
+                if (lo != hi && nextLo < hi) continue; // повтор или число уже есть во множестве
+                nextHi = nextLo + 1;
+                if (inserted != 0) inserted[count] = nextLo;
+                ++count;
+            }
+            else {
+                nextLo = run->second;
+                nextHi = run->first;
+                ++run;
+            }
+            if (lo != hi && nextLo == hi) {
+                hi = nextHi;
+            }
+            else {
+                if (lo != hi) merged.insert(merged.end(), RunMap::value_type(hi, lo));
+                lo = nextLo;
+                hi = nextHi;
+            }
+        }
+        if (lo != hi) merged.insert(merged.end(), RunMap::value_type(hi, lo));
+        runs_.swap(merged);
+        size_ += count;
+        return count;
+    }
+
+    /// Возвращает true, если множество пусто или состоит ровно из чисел 0, 1, ..., Size() - 1
+    bool IsPrefix() const {
+        return Empty() || (runs_.size() == 1 && runs_.begin()->second == 0);
+    }
+
+    /** @brief Обойти множество по отрезкам подряд идущих чисел.
+    @param fn функтор с оператором void operator()(uint lo, uint hi), отрезок [lo, hi).
+    */
+    template <typename F>
+    void ForEachRun(F& fn) const {
+        for (RunMap::const_iterator it = runs_.begin(); it != runs_.end(); ++it) {
+            fn(it->second, it->first);
+        }
+    }
+
+    /// Удалить все числа
+    void Clear() {
+        runs_.clear();
+        size_ = 0;
+    }
+};
+
+} // end of yadsl
+
+#endif // YADSL_INTRUNSET_H
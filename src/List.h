@@ -2,10 +2,21 @@
 #define YADSL_LIST_H
 
 #include <vector>
+#include <new>
+#include <iterator>
+#include <utility> // std::move(), std::forward()
+#include <cstddef> // ptrdiff_t
 #include <wx/wx.h>
 #include <wx/SharedPtr.h>
 
-#define YADSL_LIST_TEST 1
+#include "BaseTypes.h"
+#include "ClassInstMemBlockPool.h"
+#include "AllocStats.h"
+
+// 1 - узлы печатают свое создание и уничтожение (отладка)
+#ifndef YADSL_LIST_TEST
+#define YADSL_LIST_TEST 0
+#endif
 
 #if YADSL_LIST_TEST
 #include <stdio.h>
@@ -13,33 +24,57 @@
 
 namespace yadsl
 {
-enum {kPOD_LIST = 1};
+
+/** @brief Двусвязный список с узлами из пула.
+
+Узлы выделяются из пула List::Pool, который хранит их в непрерывных слябах (@see ClassInstanceMemBlockPool).
+Несколько списков с одинаковыми параметрами шаблона могут делить один пул: узлы, освобожденные одним списком,
+переиспользует другой, а узлы всех списков лежат плотно. Список без внешнего пула создает собственный пул
+при первой вставке; первые kInlineNodeNum узлов такой пул держит в себе, а слябы и счетчики в AllocStatsRegistry
+заводит, только когда список их перерастет. Поэтому множество коротких списков с собственными пулами обходится
+одним выделением памяти на список. Голова и хвост хранятся в самом списке, поэтому пустой список не выделяет памяти.
+@code
+List<Particle*, kPOD_LIST>::Pool pool(1024);
+List<Particle*, kPOD_LIST> alive(pool), dying(pool);
+@endcode
+*/
 template <typename T, int POD = 0>
 class List{
 public:
-    class Node {
+    class Node;
+    class Pool;
+
+    enum { kInlineNodeNum = 4 }; ///< число узлов, которые собственный пул списка выдает без слябов
+
+    // Звенья узла; голова и хвост списка - звено без данных
+    struct Link {
+        Node *next_, *prev_;
+        Link() : next_(0), prev_(0) {}
+    };
+
+    class Node : private Link {
         friend class List<T, POD>;
         friend class List<T, POD>::Pool;
     private:
-        Node *next_, *prev_;
-        uint8_t data_[sizeof(T)];
+        alignas(T) uint8_t data_[sizeof(T)];
 
     public:
-        Node() : next_(0), prev_(0) {
+        Node() {
 #if YADSL_LIST_TEST
-            printf("Node (%x) ctor\n", (int)this);
+            printf("Node (%p) ctor\n", (void*)this);
 #endif
         }
 
-        const Node* GetNext() const { return next_; }
-        Node* GetNext() { return next_; }
-        const Node* GetPrev() const { return prev_; }
-        Node* GetPrev() { return prev_; }
+        const Node* GetNext() const { return this->next_; }
+        Node* GetNext() { return this->next_; }
+        const Node* GetPrev() const { return this->prev_; }
+        Node* GetPrev() { return this->prev_; }
 
         T& GetData() { T* t = reinterpret_cast<T*>(&data_[0]); return *t; }
+        const T& GetData() const { const T* t = reinterpret_cast<const T*>(&data_[0]); return *t; }
         ~Node() {
 #if YADSL_LIST_TEST
-            printf("~Node (%x)\n", (int)this);
+            printf("~Node (%p)\n", (void*)this);
 #endif
         }
     };
@@ -47,134 +82,476 @@ public:
 private:
     typedef Node* NodePtr;
 
+public:
+    /** @brief Пул узлов, который могут делить несколько списков.
+    Пул должен пережить все списки, которые его используют. Пул не потокобезопасен.
+    */
     class Pool {
-        typedef std::vector<NodePtr> NodePtrVec;
-        NodePtrVec freeV_;
-        size_t cNewCalls_; // счетчик вызовов new
+        friend class List<T, POD>;
+        typedef ClassInstanceMemBlockPool<Node> SlabPool;
+
+        // пул слябов, конструируется на месте: сразу у общего пула, при росте списка - у собственного
+        alignas(SlabPool) uint8_t slabsMem_[sizeof(SlabPool)];
+        bool fSlabs_;           // пул слябов создан
+        uint slabSize_;         // число узлов в слябе
+        NodePtr recycled_;      // цепочка (по next_) узлов, возвращенных clear() целиком
+        size_t recycledNum_;    // число узлов в recycled_
+        uint inlineNum_;        // число узлов inline_, которые пул может выдать (0 у общего пула)
+        uint inlineTouchedNum_; // число узлов inline_, которые хоть раз выдавались
+        uint inlineLiveNum_;    // число выданных узлов inline_
+        NodePtr inlineFree_;    // цепочка (по next_) освобожденных узлов inline_
+        alignas(Node) uint8_t inline_[kInlineNodeNum * sizeof(Node)]; // узлы собственного пула до роста списка
+
+        Pool(const Pool&);
+        Pool& operator=(const Pool&);
+
+        // Собственный пул списка: слябы и счетчики заводятся, когда кончатся узлы inline_
+        struct OwnTag {};
+        explicit Pool(OwnTag) : fSlabs_(false), slabSize_(SlabPool::kDefaultSlabSize), recycled_(0), recycledNum_(0),
+            inlineNum_(kInlineNodeNum), inlineTouchedNum_(0), inlineLiveNum_(0), inlineFree_(0) {}
+
+        SlabPool& Slabs() {
+            if (!fSlabs_) {
+                new(slabsMem_) SlabPool(slabSize_);
+                fSlabs_ = true;
+                Slabs().Stats().SetName("List::Pool");
+            }
+            return *reinterpret_cast<SlabPool*>(slabsMem_);
+        }
+        const SlabPool& Slabs() const { return *reinterpret_cast<const SlabPool*>(slabsMem_); }
+
+        bool IsInline(NodePtr p) const {
+            const uint8_t* mem = reinterpret_cast<const uint8_t*>(p);
+            return mem >= inline_ && mem < inline_ + sizeof(inline_);
+        }
 
     public:
-        Pool() : cNewCalls_(0) {}
+        /// @param slabSize число узлов в слябе (@see ClassInstanceMemBlockPool)
+        explicit Pool(uint slabSize = ClassInstanceMemBlockPool<Node>::kDefaultSlabSize) :
+            fSlabs_(false), slabSize_(slabSize), recycled_(0), recycledNum_(0),
+            inlineNum_(0), inlineTouchedNum_(0), inlineLiveNum_(0), inlineFree_(0) {
+            Slabs();
+        }
 
         ~Pool() {
 #ifdef YADSL_USE_WXDEBUG
-            wxASSERT(freeV_.size() == cNewCalls_);
+            wxASSERT_MSG(LiveNodeNum() == 0, wxT("all lists must be destroyed before their node pool"));
 #endif
-            for (size_t i = 0; i < freeV_.size(); ++i) {
-                delete freeV_[i];
-            }
+            if (fSlabs_) Slabs().~SlabPool();
         }
 
+        /// Выделить узел, данные в узле не конструируются. Сначала расходуются узлы, возвращенные цепочкой.
         NodePtr Alloc() {
-            if (freeV_.empty()){
-                freeV_.push_back(new Node);
-                cNewCalls_++;
+            if (recycled_ != 0) {
+                NodePtr node = recycled_;
+                recycled_ = node->next_;
+                --recycledNum_;
+                return node;
+            }
+            if (inlineFree_ != 0) {
+                NodePtr node = inlineFree_;
+                inlineFree_ = node->next_;
+                ++inlineLiveNum_;
+                return new(node) Node();
+            }
+            if (inlineTouchedNum_ < inlineNum_) {
+                ++inlineLiveNum_;
+                return new(&inline_[sizeof(Node) * inlineTouchedNum_++]) Node();
             }
-            NodePtr p = freeV_.back();
-            freeV_.pop_back();
-            return p;
+            void* mem = Slabs().Alloc();
+            if (mem == 0) throw std::bad_alloc();
+            return new(mem) Node();
         }
 
+        /// Вернуть узел в пул, данные в узле к этому моменту должны быть разрушены
         void Free(NodePtr p) {
-            if (!POD) {
-                T& data = p->GetData();
-                data.~T();
+            p->~Node();
+            if (IsInline(p)) {
+                p->next_ = inlineFree_;
+                inlineFree_ = p;
+                --inlineLiveNum_;
+                return;
             }
-            freeV_.push_back(p);
+            Slabs().Free(p);
+        }
+
+        /** @brief Вернуть в пул цепочку узлов first..last, связанную по next_, за O(1).
+        Данные в узлах к этому моменту должны быть разрушены. Узлы цепочки остаются занятыми в слябах
+        (и в счетчиках Stats()), пока их не расходует Alloc() или не вернет в слябы Trim().
+        */
+        void Recycle(NodePtr first, NodePtr last, size_t n) {
+            last->next_ = recycled_;
+            recycled_ = first;
+            recycledNum_ += n;
         }
+
+        /** @brief Вернуть узлы, полученные цепочкой, в слябы, а пустые слябы - в кучу.
+        @param keepEmptySlabs сколько пустых слябов оставить в пуле (@see ClassInstanceMemBlockPool::Trim()).
+        @return число возвращенных в кучу слябов.
+        */
+        uint Trim(uint keepEmptySlabs = 0) {
+            while (recycled_ != 0) {
+                NodePtr node = recycled_;
+                recycled_ = node->next_;
+                Free(node);
+            }
+            recycledNum_ = 0;
+            return fSlabs_ ? Slabs().Trim(keepEmptySlabs) : 0;
+        }
+
+        /// Число узлов, выданных спискам
+        uint LiveNodeNum() const { return uint((fSlabs_ ? Slabs().LiveBlockNum() : 0) + inlineLiveNum_ - recycledNum_); }
+        /// Число узлов, возвращенных цепочкой и ждущих повторного выделения
+        uint RecycledNodeNum() const { return uint(recycledNum_); }
+        /** @brief Счетчики пула (@see AllocStats).
+        Узлы, которые собственный пул списка держит в себе, в счетчиках не учитываются.
+        */
+        AllocStats& Stats() { return Slabs().Stats(); }
+    };
+
+private:
+    /* Итератор по узлам списка. Конец списка - нулевой узел, поэтому итератор помнит список,
+    чтобы из end() можно было шагнуть назад к последнему узлу.
+    */
+    template <typename NodeT, typename V>
+    class IteratorT {
+        friend class List<T, POD>;
+        template <typename N2, typename V2> friend class IteratorT;
+
+        NodeT* node_;
+        const List* list_;
+
+        IteratorT(NodeT* node, const List* list) : node_(node), list_(list) {}
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        IteratorT() : node_(0), list_(0) {}
+        /// iterator приводится к const_iterator
+        template <typename N2, typename V2>
+        IteratorT(const IteratorT<N2, V2>& oth) : node_(oth.node_), list_(oth.list_) {}
+
+        /// Узел, на который указывает итератор (0 для end())
+        NodeT* GetNode() const { return node_; }
+
+        reference operator*() const { return node_->GetData(); }
+        pointer operator->() const { return &node_->GetData(); }
+
+        IteratorT& operator++() { node_ = node_->GetNext(); return *this; }
+        IteratorT operator++(int) { IteratorT it(*this); node_ = node_->GetNext(); return it; }
+        IteratorT& operator--() { node_ = (node_ != 0) ? node_->GetPrev() : list_->headTail_.prev_; return *this; }
+        IteratorT operator--(int) { IteratorT it(*this); --*this; return it; }
+
+        template <typename N2, typename V2>
+        bool operator==(const IteratorT<N2, V2>& oth) const { return node_ == oth.node_; }
+        template <typename N2, typename V2>
+        bool operator!=(const IteratorT<N2, V2>& oth) const { return node_ != oth.node_; }
     };
 
-    Pool pool_;
-    NodePtr headTail_;
 public:
-    List() : headTail_(0) {
-        headTail_ = pool_.Alloc();
-    }
+    typedef T value_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef IteratorT<Node, T> iterator;
+    typedef IteratorT<const Node, const T> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
 
-    ~List() {
-#ifdef YADSL_USE_WXDEBUG
-        wxASSERT(empty());
-#endif
-        pool_.Free(headTail_);
+private:
+    Pool* pool_;        // пул узлов, 0 - собственный пул еще не создан
+    bool fOwnPool_;     // пул создан списком и уничтожается вместе с ним
+    Link headTail_;     // next_ - первый узел, prev_ - последний
+    size_t nodeNum_;    // число узлов в списке
+
+    Pool& GetPool() {
+        if (pool_ == 0) {
+            pool_ = new Pool(typename Pool::OwnTag());
+            fOwnPool_ = true;
+        }
+        return *pool_;
     }
 
-    bool valid() const { return ((headTail_->next_ == 0 && headTail_->prev_ == 0) || (headTail_->next_ != 0 && headTail_->prev_ != 0)); }
-    bool empty() const {
-#ifdef YADSL_USE_WXDEBUG
-        wxASSERT(valid());
-#endif
-        return headTail_->next_ == 0;
+    // Создать узел с данными, сконструированными из args
+    template <typename... Args>
+    NodePtr CreateNode(Args&&... args) {
+        Pool& pool = GetPool();
+        NodePtr node = pool.Alloc();
+        try {
+            new((void*)&node->GetData()) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            pool.Free(node);
+            throw;
+        }
+        return node;
     }
 
-    NodePtr push_front(const T& data) {
-        NodePtr node = pool_.Alloc();
+    void DestroyNode(NodePtr node) {
         if (!POD) {
-            new((void*)&node->GetData()) T(data);
+            T& data = node->GetData();
+            data.~T();
+        }
+        pool_->Free(node);
+    }
+
+    // Вставить цепочку first..last из n узлов перед pos, 0 - в конец списка
+    void LinkBefore(NodePtr first, NodePtr last, size_t n, NodePtr pos) {
+        NodePtr prev = (pos != 0) ? pos->prev_ : headTail_.prev_;
+        first->prev_ = prev;
+        last->next_ = pos;
+        if (prev != 0) {
+            prev->next_ = first;
         }
         else {
-            node->GetData() = data;
+            headTail_.next_ = first;
         }
-
-        if (headTail_->next_ == 0) { // список пуст
-            headTail_->prev_ = node;
+        if (pos != 0) {
+            pos->prev_ = last;
         }
         else {
-            headTail_->next_->prev_ = node;
-            node->next_ = headTail_->next_;
+            headTail_.prev_ = last;
         }
-
-        headTail_->next_ = node;
-        return node;
+        nodeNum_ += n;
     }
 
-    NodePtr push_back(const T& data) {
-        NodePtr node = pool_.Alloc();
-        if (!POD) {
-            new((void*)&node->GetData()) T(data);
+    void LinkBefore(NodePtr node, NodePtr pos) { LinkBefore(node, node, 1, pos); }
+
+    // Исключить из списка цепочку first..last из n узлов, связи внутри цепочки сохраняются
+    void Unlink(NodePtr first, NodePtr last, size_t n) {
+        if (last->next_ != 0) {
+            last->next_->prev_ = first->prev_;
         }
         else {
-            node->GetData() = data;
+            headTail_.prev_ = first->prev_;
         }
-
-        if (headTail_->prev_ == 0) { // список пуст
-            headTail_->next_ = node;
+        if (first->prev_ != 0) {
+            first->prev_->next_ = last->next_;
         }
         else {
-            headTail_->prev_->next_ = node;
-            node->prev_ = headTail_->prev_;
+            headTail_.next_ = last->next_;
+        }
+        first->prev_ = last->next_ = 0;
+        nodeNum_ -= n;
+    }
+
+    void Unlink(NodePtr node) { Unlink(node, node, 1); }
+
+    // Проверка, что узлы other можно перенести в этот список
+    void CheckSplice(const List& other) const {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT_MSG(other.empty() || pool_ == other.pool_, wxT("splice needs lists sharing one node pool"));
+#else
+        YADSL_UNUSED_FUNC_PARAM(other);
+#endif
+    }
+
+    List(const List&);
+    List& operator=(const List&);
+
+public:
+    /// Список с собственным пулом узлов, который создается при первой вставке
+    List() : pool_(0), fOwnPool_(false), nodeNum_(0) {}
+
+    /// Список, выделяющий узлы из общего пула
+    explicit List(Pool& pool) : pool_(&pool), fOwnPool_(false), nodeNum_(0) {}
+
+    /// Перемещение: узлы и пул переходят к новому списку без копирования данных, oth остается пустым
+    List(List&& oth) : pool_(oth.pool_), fOwnPool_(oth.fOwnPool_), headTail_(oth.headTail_), nodeNum_(oth.nodeNum_) {
+        oth.fOwnPool_ = false;
+        if (fOwnPool_) oth.pool_ = 0;
+        oth.headTail_ = Link();
+        oth.nodeNum_ = 0;
+    }
+
+    /// Перемещающее присваивание: прежние узлы списка уничтожаются, узлы и пул oth переходят к списку
+    List& operator=(List&& oth) {
+        if (this != &oth) {
+            clear();
+            if (fOwnPool_) delete pool_;
+            pool_ = oth.pool_;
+            fOwnPool_ = oth.fOwnPool_;
+            headTail_ = oth.headTail_;
+            nodeNum_ = oth.nodeNum_;
+            oth.fOwnPool_ = false;
+            if (fOwnPool_) oth.pool_ = 0;
+            oth.headTail_ = Link();
+            oth.nodeNum_ = 0;
         }
+        return *this;
+    }
+
+    ~List() {
+        clear();
+        if (fOwnPool_) delete pool_;
+    }
+
+    bool valid() const { return ((headTail_.next_ == 0 && headTail_.prev_ == 0) || (headTail_.next_ != 0 && headTail_.prev_ != 0)); }
+    bool empty() const {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(valid());
+#endif
+        return headTail_.next_ == 0;
+    }
+    /// Число элементов, O(1)
+    size_t size() const { return nodeNum_; }
+
+    NodePtr push_front(const T& data) { return emplace_front(data); }
+    NodePtr push_front(T&& data) { return emplace_front(std::move(data)); }
+    NodePtr push_back(const T& data) { return emplace_back(data); }
+    NodePtr push_back(T&& data) { return emplace_back(std::move(data)); }
+
+    /// Сконструировать элемент в начале списка из args
+    template <typename... Args>
+    NodePtr emplace_front(Args&&... args) {
+        NodePtr node = CreateNode(std::forward<Args>(args)...);
+        LinkBefore(node, headTail_.next_);
+        return node;
+    }
 
-        headTail_->prev_ = node;
+    /// Сконструировать элемент в конце списка из args
+    template <typename... Args>
+    NodePtr emplace_back(Args&&... args) {
+        NodePtr node = CreateNode(std::forward<Args>(args)...);
+        LinkBefore(node, 0);
         return node;
     }
 
+    /// Сконструировать элемент перед pos из args, pos == end() - в конце списка
+    template <typename... Args>
+    NodePtr emplace_before(const_iterator pos, Args&&... args) {
+        NodePtr node = CreateNode(std::forward<Args>(args)...);
+        LinkBefore(node, const_cast<NodePtr>(pos.GetNode()));
+        return node;
+    }
+
+    /// Вставка перед pos, как в std::list
+    template <typename... Args>
+    iterator emplace(const_iterator pos, Args&&... args) {
+        return iterator(emplace_before(pos, std::forward<Args>(args)...), this);
+    }
+    iterator insert(const_iterator pos, const T& data) { return emplace(pos, data); }
+    iterator insert(const_iterator pos, T&& data) { return emplace(pos, std::move(data)); }
+
     void erase(NodePtr node) {
+        Unlink(node);
+        DestroyNode(node);
+    }
 
-        if (node->next_ != 0) {
-            node->next_->prev_ = node->prev_;
-        }
-        else {
-            headTail_->prev_ = node->prev_;
-        }
-        if (node->prev_ != 0) {
-            node->prev_->next_ = node->next_;
-        }
-        else {
-            headTail_->next_ = node->next_;
-        }
-        node->next_ = node->prev_ = 0;
+    /// Удалить элемент в pos, возвращает итератор на следующий элемент
+    iterator erase(const_iterator pos) {
+        NodePtr node = const_cast<NodePtr>(pos.GetNode());
+        iterator next(node->next_, this);
+        erase(node);
+        return next;
+    }
 
-        pool_.Free(node);
+    /// Удалить элементы [first, last), возвращает last
+    iterator erase(const_iterator first, const_iterator last) {
+        while (first != last) first = erase(first);
+        return iterator(const_cast<NodePtr>(last.GetNode()), this);
     }
 
+    void pop_front() { erase(GetFirst()); }
+    void pop_back() { erase(GetLast()); }
+
+    /** @brief Удалить все элементы.
+    Узлы возвращаются в пул одной цепочкой за O(1) (@see Pool::Recycle()); у не-POD списка перед этим
+    вызываются деструкторы элементов.
+    */
     void clear() {
-        while (!empty()) erase(GetFirst());
+        if (empty()) return;
+        if (!POD) {
+            for (NodePtr node = headTail_.next_; node != 0; node = node->next_) {
+                T& data = node->GetData();
+                data.~T();
+            }
+        }
+        pool_->Recycle(headTail_.next_, headTail_.prev_, nodeNum_);
+        headTail_ = Link();
+        nodeNum_ = 0;
+    }
+
+    /** @brief Перенести все узлы other перед pos за O(1), без копирования данных и выделения памяти.
+    Списки должны делить один пул узлов (@see List(Pool&)).
+    */
+    void splice(const_iterator pos, List& other) {
+        CheckSplice(other);
+        if (&other == this || other.empty()) return;
+        NodePtr first = other.headTail_.next_;
+        NodePtr last = other.headTail_.prev_;
+        size_t n = other.nodeNum_;
+        other.headTail_ = Link();
+        other.nodeNum_ = 0;
+        LinkBefore(first, last, n, const_cast<NodePtr>(pos.GetNode()));
+    }
+    void splice(const_iterator pos, List&& other) { splice(pos, other); }
+
+    /// Перенести узел it из other перед pos за O(1). other может быть этим же списком.
+    void splice(const_iterator pos, List& other, const_iterator it) {
+        CheckSplice(other);
+        NodePtr node = const_cast<NodePtr>(it.GetNode());
+        NodePtr at = const_cast<NodePtr>(pos.GetNode());
+        if (node == at || (&other == this && node->next_ == at)) return; // узел уже на месте
+        other.Unlink(node);
+        LinkBefore(node, at);
     }
+    void splice(const_iterator pos, List&& other, const_iterator it) { splice(pos, other, it); }
+
+    /** @brief Перенести узлы [first, last) из other перед pos.
+    Внутри одного списка перенос идет за O(1), между списками - за время подсчета числа переносимых узлов
+    (размер списков хранится). pos не должен лежать внутри [first, last).
+    */
+    void splice(const_iterator pos, List& other, const_iterator first, const_iterator last) {
+        CheckSplice(other);
+        if (first == last) return;
+        NodePtr from = const_cast<NodePtr>(first.GetNode());
+        NodePtr to = const_cast<NodePtr>((--const_iterator(last)).GetNode());
+        size_t n = 0;
+        if (&other != this) {
+            for (const_iterator it = first; it != last; ++it) ++n;
+        }
+        other.Unlink(from, to, n);
+        LinkBefore(from, to, n, const_cast<NodePtr>(pos.GetNode()));
+    }
+    void splice(const_iterator pos, List&& other, const_iterator first, const_iterator last) { splice(pos, other, first, last); }
+
+    /// Пул узлов списка, собственный пул создается при первом обращении
+    Pool& GetNodePool() { return GetPool(); }
+    /// Счетчики пула узлов списка (@see AllocStats)
+    AllocStats& Stats() { return GetPool().Stats(); }
 
-    NodePtr GetFirst() { return headTail_->next_; }
-    const NodePtr GetFirst() const { return headTail_->next_; }
+    NodePtr GetFirst() { return headTail_.next_; }
+    const Node* GetFirst() const { return headTail_.next_; }
 
-    NodePtr GetLast() { return headTail_->prev_; }
-    const NodePtr GetLast() const { return headTail_->prev_; }
+    NodePtr GetLast() { return headTail_.prev_; }
+    const Node* GetLast() const { return headTail_.prev_; }
+
+    /// Итератор на элемент в узле node
+    iterator iterator_to(NodePtr node) { return iterator(node, this); }
+    const_iterator iterator_to(const Node* node) const { return const_iterator(node, this); }
+
+    T& front() { return headTail_.next_->GetData(); }
+    const T& front() const { return headTail_.next_->GetData(); }
+    T& back() { return headTail_.prev_->GetData(); }
+    const T& back() const { return headTail_.prev_->GetData(); }
+
+    iterator begin() { return iterator(headTail_.next_, this); }
+    const_iterator begin() const { return const_iterator(headTail_.next_, this); }
+    const_iterator cbegin() const { return begin(); }
+    iterator end() { return iterator(0, this); }
+    const_iterator end() const { return const_iterator(0, this); }
+    const_iterator cend() const { return end(); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
 
 };
 
@@ -190,6 +567,7 @@ public:
 
 #include <stdlib.h> // rand()
 #include  <map>
+#include <algorithm>
 
 int Random(int high) {
     double k = (double)rand() / RAND_MAX;
@@ -257,6 +635,74 @@ void Test2() {
 
 }
 
+// Два списка на общем пуле: узлы, освобожденные одним списком, достаются другому
+void Test3() {
+    typedef yadsl::List<int, yadsl::kPOD_LIST> IntList;
+    IntList::Pool pool(256);
+    IntList alive(pool), dead(pool);
+    for (int i = 0; i < 1000; ++i) alive.push_back(i);
+    for (int k = 0; k < 100; ++k) {
+        while (!alive.empty()) {
+            dead.push_back(alive.GetFirst()->GetData());
+            alive.erase(alive.GetFirst());
+        }
+        while (!dead.empty()) {
+            alive.push_back(dead.GetLast()->GetData());
+            dead.erase(dead.GetLast());
+        }
+    }
+    yadsl::AllocStats::Snapshot s;
+    pool.Stats().Read(s);
+    printf("live nodes %u, allocs %llu, bytes reserved %llu\n", pool.LiveNodeNum(),
+        (unsigned long long)s.allocNum_, (unsigned long long)s.reservedBytes_);
+    alive.clear();
+}
+
+// Итераторы, emplace и перемещение
+void Test4() {
+    typedef yadsl::List<std::string> StrList;
+    StrList::Pool pool;
+    StrList l(pool);
+    std::string s("Rebellion");
+    l.push_back(std::move(s));
+    l.emplace_back(3, 'x');
+    l.emplace_front("The clans are marching");
+    l.emplace_before(std::find(l.begin(), l.end(), std::string("xxx")), "Armed");
+    l.insert(l.end(), "Round table");
+    for (const std::string& str : l) printf("%s\n", str.c_str());
+    for (StrList::reverse_iterator it = l.rbegin(); it != l.rend(); ++it) printf("%s\n", it->c_str());
+    printf("size %u, long names %u\n", (uint)l.size(), (uint)std::count_if(l.begin(), l.end(),
+        [](const std::string& str) { return str.size() > 5; }));
+
+    StrList moved(std::move(l));
+    printf("after move: %u and %u\n", (uint)l.size(), (uint)moved.size());
+    for (StrList::iterator it = moved.begin(); it != moved.end();) {
+        if (it->size() < 5) it = moved.erase(it);
+        else ++it;
+    }
+    printf("size after erase %u, back %s\n", (uint)moved.size(), moved.back().c_str());
+}
+
+// Перенос узлов между списками на общем пуле и очистка цепочкой
+void Test5() {
+    typedef yadsl::List<int, yadsl::kPOD_LIST> IntList;
+    IntList::Pool pool;
+    IntList a(pool), b(pool);
+    for (int i = 0; i < 10; ++i) a.push_back(i);
+    b.splice(b.end(), a, std::find(a.begin(), a.end(), 3), std::find(a.begin(), a.end(), 7)); // 3 4 5 6
+    b.splice(b.begin(), a, a.begin());                  // 0 3 4 5 6
+    a.splice(a.end(), a, a.begin());                    // 2 7 8 9 1
+    b.splice(b.end(), a, std::prev(a.end()));           // 0 3 4 5 6 1, в a остается 2 7 8 9
+    b.splice(std::next(b.begin()), a);                  // 0 2 7 8 9 3 4 5 6 1
+    for (int i : b) printf("%d ", i);
+    printf("\nsizes %u and %u\n", (uint)a.size(), (uint)b.size());
+    b.clear();
+    printf("live %u, recycled %u\n", pool.LiveNodeNum(), pool.RecycledNodeNum());
+    a.push_back(1);
+    a.clear();
+    printf("slabs released %u, live %u\n", pool.Trim(), pool.LiveNodeNum());
+}
+
 int main(){
 
     Test();
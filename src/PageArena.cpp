@@ -0,0 +1,196 @@
+#include "PageArena.h"
+#include "Utils.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+namespace yadsl
+{
+
+size_t PageArena::SystemPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+PageArena::PageArena(size_t reserveBytes, size_t commitChunk, uint flags) :
+    base_(0), reserved_(0), committed_(0), top_(0), commitChunk_(0), pageSize_(SystemPageSize()),
+    freeBytes_(0), fHugeTlb_(false) {
+    commitChunk_ = AlignUp(commitChunk == 0 ? pageSize_ : commitChunk, pageSize_);
+    Reserve(AlignUp(reserveBytes, (flags & kPageArena_HugePages) ? size_t(kHugePageSize) : pageSize_), flags);
+}
+
+PageArena::~PageArena() {
+    if (base_ == 0) return;
+#ifdef _WIN32
+    VirtualFree(base_, 0, MEM_RELEASE);
+#else
+    munmap(base_, reserved_);
+#endif
+}
+
+#ifdef _WIN32
+
+void PageArena::Reserve(size_t reserveBytes, uint flags) {
+    if (flags & kPageArena_HugePages) {
+        // большие страницы Windows фиксируются сразу и требуют права SeLockMemoryPrivilege
+        size_t largePage = GetLargePageMinimum();
+        if (largePage != 0) {
+            size_t bytes = AlignUp(reserveBytes, largePage);
+            base_ = static_cast<uint8_t*>(VirtualAlloc(0, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+            if (base_ != 0) {
+                reserved_ = committed_ = bytes;
+                pageSize_ = largePage;
+                fHugeTlb_ = true;
+                return;
+            }
+        }
+    }
+    base_ = static_cast<uint8_t*>(VirtualAlloc(0, reserveBytes, MEM_RESERVE, PAGE_NOACCESS));
+    if (base_ != 0) reserved_ = reserveBytes;
+}
+
+bool PageArena::Commit(size_t upTo) {
+    size_t target = AlignUp(upTo, commitChunk_);
+    if (target > reserved_) target = reserved_;
+    if (VirtualAlloc(base_ + committed_, target - committed_, MEM_COMMIT, PAGE_READWRITE) == 0) {
+        return false;
+    }
+    committed_ = target;
+    return true;
+}
+
+void PageArena::Discard(void* p, size_t size) {
+    uint8_t* first = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<size_t>(p), pageSize_));
+    uint8_t* last = reinterpret_cast<uint8_t*>((reinterpret_cast<size_t>(p) + size) & ~(pageSize_ - 1));
+    if (first < last && !fHugeTlb_) {
+        // MEM_RESET лишь разрешил бы системе не сохранять страницы, рабочий набор при этом не уменьшается
+        VirtualFree(first, last - first, MEM_DECOMMIT);
+    }
+}
+
+bool PageArena::Recommit(void* p, size_t size) {
+    uint8_t* first = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<size_t>(p), pageSize_));
+    uint8_t* last = reinterpret_cast<uint8_t*>((reinterpret_cast<size_t>(p) + size) & ~(pageSize_ - 1));
+    if (first < last && !fHugeTlb_) {
+        return VirtualAlloc(first, last - first, MEM_COMMIT, PAGE_READWRITE) != 0;
+    }
+    return true;
+}
+
+#else
+
+void PageArena::Reserve(size_t reserveBytes, uint flags) {
+    if (flags & kPageArena_HugePages) {
+#ifdef MAP_HUGETLB
+        // явные большие страницы резервируются в пуле ядра сразу (без MAP_NORESERVE), иначе при нехватке
+        // больших страниц mmap прошел бы успешно, а первое обращение к памяти закончилось бы SIGBUS
+        void* p = mmap(0, reserveBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            base_ = static_cast<uint8_t*>(p);
+            reserved_ = committed_ = reserveBytes;
+            pageSize_ = kHugePageSize;
+            fHugeTlb_ = true;
+            return;
+        }
+#endif
+        // резерв с запасом, чтобы начало арены было выровнено по большой странице (для прозрачных больших страниц)
+        void* p2 = mmap(0, reserveBytes + kHugePageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p2 == MAP_FAILED) return;
+        uint8_t* raw = static_cast<uint8_t*>(p2);
+        uint8_t* aligned = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<size_t>(raw), kHugePageSize));
+        if (aligned != raw) munmap(raw, aligned - raw);
+        if (aligned + reserveBytes != raw + reserveBytes + kHugePageSize) {
+            munmap(aligned + reserveBytes, raw + reserveBytes + kHugePageSize - (aligned + reserveBytes));
+        }
+        base_ = aligned;
+        reserved_ = reserveBytes;
+#ifdef MADV_HUGEPAGE
+        madvise(base_, reserved_, MADV_HUGEPAGE); // не критично, если ядро не поддерживает
+#endif
+        return;
+    }
+    void* p = mmap(0, reserveBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return;
+    base_ = static_cast<uint8_t*>(p);
+    reserved_ = reserveBytes;
+}
+
+bool PageArena::Commit(size_t upTo) {
+    size_t target = AlignUp(upTo, commitChunk_);
+    if (target > reserved_) target = reserved_;
+    if (mprotect(base_ + committed_, target - committed_, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    committed_ = target;
+    return true;
+}
+
+void PageArena::Discard(void* p, size_t size) {
+    uint8_t* first = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<size_t>(p), pageSize_));
+    uint8_t* last = reinterpret_cast<uint8_t*>((reinterpret_cast<size_t>(p) + size) & ~(pageSize_ - 1));
+    if (first < last) {
+        // при следующем обращении страницы будут выделены заново и заполнены нулями
+        madvise(first, last - first, MADV_DONTNEED);
+    }
+}
+
+bool PageArena::Recommit(void* p, size_t size) {
+    // после MADV_DONTNEED страницы остаются доступными и выделяются системой при первом обращении
+    YADSL_UNUSED_FUNC_PARAM(p);
+    YADSL_UNUSED_FUNC_PARAM(size);
+    return true;
+}
+
+#endif
+
+void* PageArena::Alloc(size_t size, size_t alignment) {
+#ifdef YADSL_USE_WXDEBUG
+    wxASSERT(size != 0);
+    wxASSERT((alignment & (alignment - 1)) == 0);
+#endif
+    FreeLists::iterator it = free_.find(SizeAlign(size, alignment));
+    if (it != free_.end() && !it->second.empty()) {
+        void* p = it->second.back();
+        if (!Recommit(p, size)) {
+            return 0;
+        }
+        it->second.pop_back();
+        freeBytes_ -= size;
+        return p;
+    }
+    if (base_ == 0) return 0;
+    size_t offset = AlignUp(reinterpret_cast<size_t>(base_) + top_, alignment) - reinterpret_cast<size_t>(base_);
+    if (offset > reserved_ || size > reserved_ - offset) {
+        return 0;
+    }
+    if (offset + size > committed_ && !Commit(offset + size)) {
+        return 0;
+    }
+    freeBytes_ += offset - top_; // пропуск на выравнивание не выдается никому
+    top_ = offset + size;
+    return base_ + offset;
+}
+
+void PageArena::Free(void* p, size_t size, size_t alignment) {
+#ifdef YADSL_USE_WXDEBUG
+    wxASSERT(static_cast<uint8_t*>(p) >= base_ && static_cast<uint8_t*>(p) + size <= base_ + top_);
+#endif
+    Discard(p, size);
+    free_[SizeAlign(size, alignment)].push_back(p);
+    freeBytes_ += size;
+}
+
+} // end of yadsl
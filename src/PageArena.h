@@ -0,0 +1,115 @@
+#ifndef YADSL_PAGEARENA_H
+#define YADSL_PAGEARENA_H
+
+/** @file PageArena.h.
+
+Назначение: поставщик памяти страницами из заранее зарезервированного адресного пространства.
+*/
+
+#include <map>
+#include <vector>
+#include <utility> // std::pair
+#include <stddef.h>
+#include "BaseTypes.h"
+
+namespace yadsl
+{
+
+/// Флаги арены страниц PageArena
+enum {
+    kPageArena_HugePages = 1    ///< использовать большие страницы (2 МБ), если система их предоставляет
+};
+
+/** @brief Арена страниц: непрерывный участок адресного пространства, память которого фиксируется крупными частями.
+
+Конструктор резервирует адресное пространство заданного размера (mmap с PROT_NONE, VirtualAlloc с MEM_RESERVE),
+физическая память под него не выделяется. Alloc() выдает участки подряд от начала арены и фиксирует
+(mprotect, MEM_COMMIT) память частями по commitChunk байт, когда выдача доходит до незафиксированной области.
+
+С флагом kPageArena_HugePages арена пытается получить большие страницы (MAP_HUGETLB, MEM_LARGE_PAGES),
+а если система их не предоставляет - просит прозрачные большие страницы (madvise(MADV_HUGEPAGE)) и, в худшем случае,
+работает на обычных страницах. Большие страницы уменьшают промахи TLB при обходе больших пулов. HugePages() сообщает,
+удалось ли получить большие страницы явно.
+
+Free() кладет участок в список свободных участков того же размера и выравнивания, откуда его заберет следующий Alloc().
+Целые страницы освобожденного участка возвращаются системе (madvise(MADV_DONTNEED), VirtualFree(MEM_DECOMMIT)), поэтому
+потребление физической памяти процессом действительно падает, а адреса остаются за ареной. В Windows такие страницы
+фиксируются заново, когда Alloc() выдает участок из списка свободных; явные большие страницы системе не возвращаются.
+
+Арена используется пулом ClassInstanceMemBlockPool (слябы) и кэшем StlListAllocCache (блоки узлов).
+Пример:
+@code
+PageArena arena(size_t(1) << 30, size_t(2) << 20, kPageArena_HugePages); // 1 ГБ адресов, фиксация по 2 МБ
+ClassInstanceMemBlockPool<Particle> pool(4096, &arena);
+@endcode
+
+@note арена не потокобезопасна. Память арены возвращается системе при уничтожении арены,
+арена должна пережить всех своих пользователей.
+*/
+class PageArena {
+public:
+    enum { kDefaultCommitChunk = 2 << 20 }; ///< размер части фиксации памяти по умолчанию, 2 МБ
+    enum { kHugePageSize = 2 << 20 };       ///< размер большой страницы
+
+private:
+    typedef std::pair<size_t, size_t> SizeAlign;
+    typedef std::map<SizeAlign, std::vector<void*> > FreeLists;
+
+    uint8_t* base_;         // начало зарезервированного участка
+    size_t reserved_;       // размер зарезервированного участка
+    size_t committed_;      // размер зафиксированной части от начала участка
+    size_t top_;            // смещение первого ни разу не выданного байта
+    size_t commitChunk_;    // размер части фиксации
+    size_t pageSize_;       // размер страницы, которой выделена память арены
+    size_t freeBytes_;      // размер участков в списках свободных
+    bool fHugeTlb_;         // получены ли большие страницы явно (память зафиксирована сразу)
+    FreeLists free_;        // освобожденные участки по размеру и выравниванию
+
+    // Зарезервировать адресное пространство
+    void Reserve(size_t reserveBytes, uint flags);
+    // Зафиксировать память так, чтобы зафиксированная часть покрывала первые upTo байт
+    bool Commit(size_t upTo);
+    // Вернуть системе физическую память целых страниц участка
+    void Discard(void* p, size_t size);
+    // Снова сделать доступными страницы участка, возвращенные Discard()
+    bool Recommit(void* p, size_t size);
+
+    PageArena(const PageArena&);
+    PageArena& operator=(const PageArena&);
+
+public:
+    /** @brief Конструктор.
+    @param reserveBytes размер резервируемого адресного пространства, верхняя граница памяти арены.
+    @param commitChunk размер части, которой фиксируется память.
+    @param flags флаги kPageArena_*.
+    */
+    explicit PageArena(size_t reserveBytes, size_t commitChunk = kDefaultCommitChunk, uint flags = 0);
+    ~PageArena();
+
+    /** @brief Выделить участок памяти.
+    @param size размер участка.
+    @param alignment выравнивание участка (степень двойки).
+    @return указатель на участок или 0, если зарезервированное пространство исчерпано или память не удалось зафиксировать.
+    */
+    void* Alloc(size_t size, size_t alignment = sizeof(void*));
+
+    /** @brief Вернуть участок в арену.
+    @param size, alignment - те же, что при выделении участка.
+    */
+    void Free(void* p, size_t size, size_t alignment = sizeof(void*));
+
+    /// Получены ли большие страницы явно (MAP_HUGETLB, MEM_LARGE_PAGES)
+    bool HugePages() const { return fHugeTlb_; }
+    /// Размер зарезервированного адресного пространства
+    size_t ReservedBytes() const { return reserved_; }
+    /// Размер зафиксированной части от начала арены, включая страницы свободных участков, возвращенные системе
+    size_t CommittedBytes() const { return committed_; }
+    /// Размер выданных и не возвращенных участков
+    size_t UsedBytes() const { return top_ - freeBytes_; }
+    /// Размер обычной страницы системы
+    static size_t SystemPageSize();
+};
+
+} // end of yadsl
+
+#endif // YADSL_PAGEARENA_H
@@ -0,0 +1,243 @@
+#ifndef YADSL_STL_ARENA_ALLOC_H
+#define YADSL_STL_ARENA_ALLOC_H
+
+#include <vector>
+#include <limits>
+#include <new>
+#include <cstddef> // std::max_align_t
+#include <memory> // std::addressof()
+#include <type_traits> // std::true_type
+
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+#include "BaseTypes.h"
+#include "Utils.h"
+#include "AllocStats.h"
+
+/** @file StlArenaAlloc.h.
+Арена для контейнеров stl и аллокатор, привязанный к арене.
+*/
+
+namespace yadsl {
+
+/** @brief Арена контейнеров: память выдается сдвигом указателя в блоках, которые растут вдвое,
+а освобождается только вся сразу - вызовом Reset() или уничтожением арены.
+
+Арена принадлежит вызывающему коду и должна пережить контейнеры, которые на ней построены.
+Типичное применение - временные списки одного кадра:
+@code
+StlAllocArena frameArena;
+{
+    std::list<Contact, StlArenaAllocator<Contact> > contacts((StlArenaAllocator<Contact>(frameArena)));
+    //...
+}
+frameArena.Reset(); // вся память кадра возвращается без обхода узлов
+@endcode
+@note арена не потокобезопасна.
+*/
+class StlAllocArena {
+private:
+    enum { kMaxBlockBytes = 1 << 20 }; // предел роста блока
+
+    struct Block {
+        uint8_t* mem_;
+        size_t bytes_;
+    };
+
+    std::vector<Block> blocks_; // блоки в порядке заполнения
+    size_t current_;            // индекс текущего блока в blocks_
+    uint8_t* top_;              // первый свободный байт текущего блока
+    uint8_t* end_;              // конец текущего блока
+    uint8_t* last_;             // последний выданный участок, его освобождение откатывает top_
+    size_t nextBlockBytes_;     // размер следующего нового блока
+    size_t firstBlockBytes_;
+    AllocStats stats_;
+
+    /* Перейти к следующему блоку, в который помещается size байт с выравниванием alignment.
+    Возвращает true, если блок пришлось выделить из кучи.
+    */
+    bool NextBlock(size_t size, size_t alignment) {
+        // после Reset() блоки переиспользуются по порядку
+        while (++current_ < blocks_.size()) {
+            Block& b = blocks_[current_];
+            if (AlignUp(reinterpret_cast<size_t>(b.mem_), alignment) + size <= reinterpret_cast<size_t>(b.mem_) + b.bytes_) {
+                top_ = b.mem_;
+                end_ = b.mem_ + b.bytes_;
+                return false;
+            }
+        }
+        size_t bytes = nextBlockBytes_;
+        while (bytes < size + alignment) bytes *= 2;
+        Block b = { static_cast<uint8_t*>(AlignedAlloc(bytes, alignof(std::max_align_t))), bytes };
+        if (b.mem_ == 0) throw std::bad_alloc();
+        blocks_.push_back(b);
+        current_ = blocks_.size() - 1;
+        top_ = b.mem_;
+        end_ = b.mem_ + bytes;
+        stats_.OnReserve(bytes);
+        if (nextBlockBytes_ < kMaxBlockBytes) nextBlockBytes_ *= 2;
+        return true;
+    }
+
+    StlAllocArena(const StlAllocArena&);
+    StlAllocArena& operator=(const StlAllocArena&);
+
+public:
+    enum { kDefaultFirstBlockBytes = 4096 }; ///< размер первого блока по умолчанию
+
+    /** @brief Конструктор. Память не выделяется до первого запроса.
+    @param firstBlockBytes размер первого блока, следующие блоки вдвое больше предыдущего.
+    */
+    explicit StlAllocArena(size_t firstBlockBytes = kDefaultFirstBlockBytes) :
+        current_(0), top_(0), end_(0), last_(0), nextBlockBytes_(firstBlockBytes == 0 ? 1 : firstBlockBytes),
+        firstBlockBytes_(nextBlockBytes_), stats_("StlAllocArena", 0) {
+    }
+
+    ~StlAllocArena() {
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            AlignedFree(blocks_[i].mem_);
+        }
+    }
+
+    /** @brief Выделить участок памяти.
+    @param size размер участка.
+    @param alignment выравнивание участка (степень двойки).
+    */
+    void* Alloc(size_t size, size_t alignment) {
+        uint8_t* p = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<size_t>(top_), alignment));
+        bool fHit = true;
+        if (top_ == 0 || p + size > end_) {
+            fHit = !NextBlock(size, alignment);
+            p = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<size_t>(top_), alignment));
+        }
+        top_ = p + size;
+        last_ = p;
+        stats_.OnAlloc(fHit);
+        return p;
+    }
+
+    /** @brief Освободить участок. Память возвращается, только если это последний выделенный участок,
+    иначе она освободится при Reset().
+    */
+    void Free(void* p) {
+        if (p == last_) {
+            top_ = last_;
+            last_ = 0;
+        }
+        stats_.OnFree();
+    }
+
+    /** @brief Освободить всю память арены сразу. Блоки остаются за ареной и переиспользуются.
+    Контейнеры, построенные на арене, к этому моменту должны быть уничтожены или больше не использоваться.
+    */
+    void Reset() {
+        current_ = 0;
+        top_ = end_ = last_ = 0;
+        if (!blocks_.empty()) {
+            // начинать снова с первого блока
+            current_ = 0;
+            top_ = blocks_[0].mem_;
+            end_ = top_ + blocks_[0].bytes_;
+        }
+    }
+
+    /// Вернуть блоки арены в кучу. Как и Reset(), освобождает всю выданную память.
+    void Release() {
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            AlignedFree(blocks_[i].mem_);
+            stats_.OnRelease(blocks_[i].bytes_);
+        }
+        blocks_.clear();
+        current_ = 0;
+        top_ = end_ = last_ = 0;
+        nextBlockBytes_ = firstBlockBytes_;
+    }
+
+    /// Счетчики арены (@see AllocStats)
+    AllocStats& Stats() { return stats_; }
+};
+
+//-----------------------------------------------------------------------------
+
+/** @brief Аллокатор контейнеров stl, выделяющий память из арены StlAllocArena.
+
+deallocate() почти ничего не делает: память узлов возвращается вся сразу вместе с ареной.
+Аллокаторы равны, если привязаны к одной арене. При перемещающем присваивании и обмене контейнеров аллокатор
+переходит вместе с содержимым (propagate_on_container_move_assignment, propagate_on_container_swap), поэтому
+узлы контейнера всегда принадлежат арене его аллокатора, и перемещение списков между аренами безопасно.
+Копирующее присваивание аллокатор не переносит: копии элементов выделяются в арене контейнера-приемника.
+*/
+template <typename T>
+class StlArenaAllocator {
+private:
+    template <typename U> friend class StlArenaAllocator;
+
+    StlAllocArena* arena_;
+
+public:
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T value_type;
+
+	typedef std::false_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	template<typename U>
+	struct rebind{
+		typedef StlArenaAllocator<U> other;
+	};
+
+    explicit StlArenaAllocator(StlAllocArena& arena) throw() : arena_(&arena) { }
+
+	template<typename U>
+	StlArenaAllocator(const StlArenaAllocator<U>& oth) throw() : arena_(oth.arena_) { }
+
+    /// Арена, к которой привязан аллокатор
+    StlAllocArena& Arena() const { return *arena_; }
+
+	pointer address(reference r) const noexcept { return std::addressof(r); }
+
+	const_pointer address(const_reference r) const noexcept { return std::addressof(r); }
+
+	pointer allocate(size_type num, const void* = 0) {
+		if (num > this->max_size())
+			throw std::bad_alloc();
+        return static_cast<T*>(arena_->Alloc(num * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(pointer p, size_type) {
+	    arena_->Free(p);
+    }
+
+	/// Возвращает максимальное количество элементов, для которых может быть выделена память
+	size_type max_size() const noexcept {
+		return std::numeric_limits<size_t>::max() / sizeof(T);
+	}
+
+	template<typename U, typename... Args>
+	void construct(U* p, Args&&... args) {
+		::new((void *)p) U(std::forward<Args>(args)...);
+	}
+
+	template<typename U>
+	void destroy(U* p) {
+		p->~U();
+	}
+
+	template<typename U>
+	bool operator==(const StlArenaAllocator<U>& oth) const noexcept { return arena_ == oth.arena_; }
+
+	template<typename U>
+	bool operator!=(const StlArenaAllocator<U>& oth) const noexcept { return arena_ != oth.arena_; }
+};
+
+} // end of yadsl
+
+#endif // YADSL_STL_ARENA_ALLOC_H
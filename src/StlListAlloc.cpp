@@ -93,3 +93,146 @@ int main(){
 
 
 
+
+//-----------------------------------------------------------------------------
+
+#if 0 // code for benchmark
+
+// Смешанные контейнеры: фазы попеременно заполняют и очищают списки с узлами 40 и 48 байт (64-битная сборка).
+// Узлы обоих списков попадают в класс 48 байт, поэтому вторая фаза переиспользует блоки первой.
+// Выводится память, полученная кэшами от кучи, и число обращений к куче.
+
+#include <stdio.h> // printf()
+#include <list>
+#include <string>
+
+#include "StlListAlloc.h"
+
+struct Payload24 { char data_[24]; };
+struct Payload32 { char data_[32]; };
+
+int main() {
+    const int kPhases = 20;
+    const int kNodes = 100000;
+
+    std::list<Payload24, yadsl::StlListAllocator<Payload24> > a;
+    std::list<Payload32, yadsl::StlListAllocator<Payload32> > b;
+    for (int phase = 0; phase < kPhases; ++phase) {
+        for (int i = 0; i < kNodes; ++i) {
+            if (phase & 1) b.push_back(Payload32());
+            else a.push_back(Payload24());
+        }
+        a.clear();
+        b.clear();
+    }
+
+    std::string report;
+    yadsl::AllocStatsRegistry::Instance().DumpText(report);
+    printf("%s", report.c_str());
+    return 0;
+}
+
+#endif
+
+
+//-----------------------------------------------------------------------------
+
+#if 0 // code for test: освобождение узлов в чужих потоках
+
+// Поток-производитель заполняет списки и передает их потокам-потребителям, которые освобождают узлы.
+// Производитель все это время выделяет новые узлы (и принимает удаленные освобождения). В четных раундах он
+// завершается раньше, чем потребители освободят последние его узлы, в нечетных - живет, пока они не закончат.
+// Запускать под ASan и TSan на нескольких ядрах.
+
+#include <stdio.h> // printf()
+#include <list>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+#include "StlListAlloc.h"
+
+typedef std::list<long, yadsl::StlListAllocator<long> > LongList;
+
+struct Queue {
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<LongList> lists_;
+    bool fDone_;
+
+    Queue() : fDone_(false) {}
+
+    void Push(LongList&& l) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lists_.push_back(std::move(l));
+        cv_.notify_one();
+    }
+
+    bool Pop(LongList& l) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return fDone_ || !lists_.empty(); });
+        if (lists_.empty()) return false;
+        l = std::move(lists_.front());
+        lists_.pop_front();
+        return true;
+    }
+
+    void Finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fDone_ = true;
+        cv_.notify_all();
+    }
+};
+
+int main() {
+    const int kRounds = 20;
+    const int kConsumers = 3;
+    const int kLists = 2000;
+    const int kNodes = 64;
+    long sum = 0;
+    std::mutex sumMutex;
+    for (int round = 0; round < kRounds; ++round) {
+        Queue queue;
+        std::atomic<int> consumersLeft(kConsumers);
+        std::vector<std::thread> consumers;
+        for (int i = 0; i < kConsumers; ++i) {
+            consumers.push_back(std::thread([&queue, &sum, &sumMutex, &consumersLeft] {
+                LongList l;
+                long s = 0;
+                while (queue.Pop(l)) {
+                    for (LongList::iterator it = l.begin(); it != l.end(); ++it) s += *it;
+                    l.clear(); // узлы уходят в стек удаленных освобождений кэша производителя
+                }
+                std::lock_guard<std::mutex> lock(sumMutex);
+                sum += s;
+                --consumersLeft;
+            }));
+        }
+        bool fStayAlive = (round & 1) != 0;
+        std::thread producer([&queue, &consumersLeft, fStayAlive] {
+            for (int i = 0; i < kLists; ++i) {
+                LongList l;
+                for (int k = 0; k < kNodes; ++k) l.push_back(k);
+                queue.Push(std::move(l));
+            }
+            if (fStayAlive) {
+                queue.Finish();
+                while (consumersLeft != 0) {
+                    LongList churn; // исчерпав список свободных блоков, кэш принимает удаленные освобождения
+                    for (int k = 0; k < 4 * kNodes; ++k) churn.push_back(k);
+                    std::this_thread::yield();
+                }
+            }
+        });
+        producer.join(); // в четных раундах кэш производителя живет, пока потребители не освободят его узлы
+        queue.Finish();
+        for (int i = 0; i < kConsumers; ++i) consumers[i].join();
+    }
+    printf("sum %ld (expected %ld)\n", sum, (long)kRounds * kLists * (kNodes * (kNodes - 1) / 2));
+    return 0;
+}
+
+#endif
@@ -4,27 +4,38 @@
 #include <vector>
 #include <list>
 #include <limits>
-
-#define YADSL_LISTALLOCATOR_DEBUG 1 // вкл(1)/выкл(0) отладки аллокатора списка stl
-#define YADSL_LISTALLOCATOR_DEBUG_USE_MSGBOX 1 // вкл/выкл использование диалога сообщений
-
+#include <new>
+#include <atomic>
+#include <cstddef> // std::max_align_t
+#include <algorithm> // std::find()
+#include <stdio.h> // snprintf()
 
 #ifdef YADSL_USE_WXDEBUG
 #include <wx/wx.h>
 #endif
-#include <wx/sharedptr.h>
-
-#if YADSL_LISTALLOCATOR_DEBUG
-#include <stdio.h>
-#if YADSL_LISTALLOCATOR_DEBUG_USE_MSGBOX
-#include <windows.h>
-#endif
-#endif
 
 #include "BaseTypes.h"
+#include "Utils.h"
+#include "PageArena.h"
+#include "AllocStats.h"
 
 /** @file StlListAlloc.h.
 Аллокатор для std::list.
+
+Трассировка аллокатора задается политикой - параметром шаблона Trace аллокатора и кэша. Политика - класс с методами
+@code
+void OnAllocate(const void* p, size_t size);    // выдан блок узла
+void OnDeallocate(const void* p, size_t size);  // блок узла возвращен
+void OnCacheDestroy(size_t liveNum);            // кэш уничтожается, liveNum блоков так и не вернули
+@endcode
+Экземпляр политики свой у каждого потока, его возвращает StlListAllocTraceInstance<Trace>().
+По умолчанию используется StlListAllocNullTrace, вызовы которой компилятор выбрасывает целиком.
+@code
+typedef yadsl::StlListAllocEventLogTrace<256> Log;
+std::list<Person, yadsl::StlListAllocator<Person, Log> > persons;
+//...
+yadsl::StlListAllocTraceInstance<Log>().ForEachUnfreed(Report);
+@endcode
 */
 namespace yadsl_private{
 extern const char* stlListAllocReporter;
@@ -35,16 +46,191 @@ namespace yadsl {
 using std::size_t;
 using std::ptrdiff_t;
 
+//-----------------------------------------------------------------------------
+
+/// Пустая политика трассировки: ничего не делает и ничего не стоит
+struct StlListAllocNullTrace {
+    void OnAllocate(const void*, size_t) {}
+    void OnDeallocate(const void*, size_t) {}
+    void OnCacheDestroy(size_t) {}
+};
+
+/// Политика трассировки, считающая выделения и освобождения блоков узлов
+class StlListAllocCountTrace {
+private:
+    uint64_t allocNum_;
+    uint64_t deallocNum_;
+    uint64_t leakedNum_;    // блоков, не возвращенных к уничтожению кэша
+
+public:
+    StlListAllocCountTrace() : allocNum_(0), deallocNum_(0), leakedNum_(0) {}
+
+    void OnAllocate(const void*, size_t) { ++allocNum_; }
+    void OnDeallocate(const void*, size_t) { ++deallocNum_; }
+    void OnCacheDestroy(size_t liveNum) { leakedNum_ = liveNum; }
+
+    /// Всего выделений
+    uint64_t AllocNum() const { return allocNum_; }
+    /// Всего освобождений
+    uint64_t DeallocNum() const { return deallocNum_; }
+    /// Выделено и не освобождено блоков
+    uint64_t LiveNum() const { return allocNum_ - deallocNum_; }
+    /// Число блоков, не возвращенных к уничтожению кэша
+    uint64_t LeakedNum() const { return leakedNum_; }
+};
+
+/** @brief Политика трассировки, записывающая последние Capacity событий в кольцевой буфер.
+Запись события - несколько присваиваний, без выделений памяти и системных вызовов. Для поиска утечек
+ForEachUnfreed() перечисляет блоки, выделение которых есть в журнале, а освобождение - нет.
+*/
+template <int Capacity = 1024>
+class StlListAllocEventLogTrace {
+public:
+    enum EventType { kAllocate, kDeallocate };
+
+    /// Событие журнала
+    struct Event {
+        const void* p_;     ///< блок узла
+        uint64_t seq_;      ///< порядковый номер события, с 0
+        uint32_t size_;     ///< размер узла
+        EventType type_;
+    };
+
+private:
+    Event events_[Capacity];
+    uint64_t seq_;      // число записанных событий
+
+    void Record(const void* p, size_t size, EventType type) {
+        Event& e = events_[seq_ % Capacity];
+        e.p_ = p;
+        e.seq_ = seq_++;
+        e.size_ = (uint32_t)size;
+        e.type_ = type;
+    }
+
+public:
+    StlListAllocEventLogTrace() : seq_(0) {}
+
+    void OnAllocate(const void* p, size_t size) { Record(p, size, kAllocate); }
+    void OnDeallocate(const void* p, size_t size) { Record(p, size, kDeallocate); }
+    void OnCacheDestroy(size_t) {}
+
+    /// Число событий, записанных за все время (в журнале хранятся последние Capacity)
+    uint64_t EventNum() const { return seq_; }
+
+    /** @brief Обойти события журнала от старых к новым.
+    @param fn функтор с оператором void operator()(const Event&).
+    */
+    template <typename F>
+    void ForEach(F fn) const {
+        uint64_t first = (seq_ > (uint64_t)Capacity) ? seq_ - Capacity : 0;
+        for (uint64_t i = first; i < seq_; ++i) {
+            fn(events_[i % Capacity]);
+        }
+    }
+
+    /** @brief Обойти события выделения, после которых в журнале нет освобождения того же блока, от старых к новым.
+    Блоки, выделенные раньше начала журнала, не видны. Выделяет память под временный массив.
+    @param fn функтор с оператором void operator()(const Event&).
+    */
+    template <typename F>
+    void ForEachUnfreed(F fn) const {
+        std::vector<const void*> freed;
+        std::vector<const Event*> unfreed;
+        uint64_t first = (seq_ > (uint64_t)Capacity) ? seq_ - Capacity : 0;
+        for (uint64_t i = seq_; i-- > first; ) {
+            const Event& e = events_[i % Capacity];
+            std::vector<const void*>::iterator it = std::find(freed.begin(), freed.end(), e.p_);
+            if (e.type_ == kDeallocate) {
+                if (it == freed.end()) freed.push_back(e.p_);
+            }
+            else if (it != freed.end()) {
+                freed.erase(it); // блок мог быть выделен повторно раньше
+            }
+            else {
+                unfreed.push_back(&e);
+            }
+        }
+        for (size_t i = unfreed.size(); i-- > 0; ) {
+            fn(*unfreed[i]);
+        }
+    }
+};
+
+/** @brief Экземпляр политики трассировки Trace вызывающего потока, общий для его кэшей всех размеров узлов.
+Создается при первом обращении потока раньше его кэшей и поэтому уничтожается при завершении потока после них.
+*/
+template <typename Trace>
+Trace& StlListAllocTraceInstance() {
+    static thread_local Trace trace;
+    return trace;
+}
+
+/// Политика трассировки, печатающая каждое событие в stdout (прежнее отладочное поведение аллокатора)
+struct StlListAllocPrintTrace {
+    void OnAllocate(const void* p, size_t size) {
+        printf("%s allocated mem block %p of size %d bytes\n", yadsl_private::stlListAllocReporter, p, (int)size);
+    }
+    void OnDeallocate(const void* p, size_t size) {
+        printf("%s deallocated mem block %p of size %d bytes\n", yadsl_private::stlListAllocReporter, p, (int)size);
+    }
+    void OnCacheDestroy(size_t liveNum) {
+        printf("%s cache destroyed, %d elements were not deallocated\n", yadsl_private::stlListAllocReporter, (int)liveNum);
+    }
+};
+
 
 //-----------------------------------------------------------------------------
 
-template<int N>
+/** @brief Класс размера узла: размер блока кэша, из которого выделяются узлы размера n.
+Размеры округляются вверх до кратного 16 байтам до 128 байт, дальше шаг удваивается с каждым удвоением размера
+(32 до 256, 64 до 512, 128 до 1024, затем 256). Узлы разных контейнеров с близкими размерами попадают в один класс
+и делят один кэш: блоки, освобожденные списком одного типа, переиспользует список другого типа.
+*/
+constexpr size_t StlListAllocSizeClass(size_t n) {
+    return (n <= 128) ? (n + 15) & ~size_t(15) :
+           (n <= 256) ? (n + 31) & ~size_t(31) :
+           (n <= 512) ? (n + 63) & ~size_t(63) :
+           (n <= 1024) ? (n + 127) & ~size_t(127) : (n + 255) & ~size_t(255);
+}
+
+/// Размер сегмента кэша узлов: наименьшая степень двойки, не меньшая need и bytes
+constexpr size_t StlListAllocSegmentBytes(size_t need, size_t bytes = 4096) {
+    return (bytes >= need) ? bytes : StlListAllocSegmentBytes(need, bytes * 2);
+}
+
+/** @brief Кэш блоков памяти узлов класса размера N (@see StlListAllocSizeClass()) для StlListAllocator с политикой трассировки Trace.
+
+Блоки выделяются не поштучно, а кусками. Кусок состоит из сегментов kSegmentBytes байт (степень двойки, не меньше
+страницы), выровненных по своему размеру; в начале сегмента - заголовок с указателем на кэш-владелец, за ним вплотную
+блоки. Поэтому блок не хранит ничего, кроме узла, а владелец находится по адресу блока маскированием (@see SegmentOf()).
+Число сегментов в каждом следующем куске вдвое больше, чем в предыдущем (до kMaxChunkSegments), поэтому растущий
+с нуля список обращается к куче логарифмическое число раз, а узлы, вставленные подряд, лежат в памяти рядом.
+Выделение - это снятие блока с головы списка свободных блоков (звенья хранятся в самих блоках) или сдвиг указателя
+в текущем сегменте. Куски возвращаются в кучу (или арену) только все сразу, когда ни один блок не выдан (@see ClearCache()).
+
+###Потоки###
+У каждого потока свой кэш: Instance() возвращает кэш вызывающего потока, поэтому списки разных потоков
+выделяют и освобождают узлы без блокировок и без общих строк кэша. Кэш, из которого выделен блок, указан в заголовке его сегмента.
+Блок, освобождаемый в чужом потоке, кладется без блокировки в стек удаленных освобождений кэша-владельца
+(одна операция CAS), а владелец забирает весь стек одной атомарной операцией, когда его список свободных блоков пуст.
+
+При завершении потока его кэш уничтожается, если все его блоки возвращены. Иначе кэш остается жить, пока
+узлы, выделенные в завершившемся потоке, не освободят другие потоки: последний освободивший уничтожает кэш.
+Политика трассировки тоже своя у каждого потока, удаленные освобождения учитываются владельцем при их приеме.
+*/
+template<int N, typename Trace = StlListAllocNullTrace>
 class StlListAllocCache {
 private:
     enum { kNodeMemBlockMarker = 0xA965 };
-    // Блок памяти узла списка
+    enum { kMinSegmentNodes = 16 };  // наименьшее число блоков в сегменте
+    enum { kMaxChunkSegments = 32 }; // предел роста куска
 
-    struct NodeMemBlock{
+    /* Блок памяти узла списка. Выровнен как любой тип, так как блоки лежат в сегменте вплотную; N кратно
+    этому выравниванию (@see StlListAllocSizeClass()), поэтому в сборке без отладки блок занимает ровно N байт.
+    */
+    struct alignas(std::max_align_t) NodeMemBlock{
+#ifdef YADSL_USE_WXDEBUG
         uint8_t buf_[N + 2];
         uint16_t* MarkZone() { return reinterpret_cast<uint16_t*>(&buf_[N]); }
         const uint16_t* MarkZone() const { return reinterpret_cast<const uint16_t*>(const_cast<const uint8_t*>(&buf_[N])); }
@@ -52,83 +238,401 @@ private:
         NodeMemBlock() { Mark(); }
         ~NodeMemBlock() { Mark(); }
         bool Marked() const { return (*MarkZone()) == kNodeMemBlockMarker; }
+#else
+        uint8_t buf_[N];
+#endif
+        // следующий свободный блок (пока блок свободен)
+        NodeMemBlock*& NextFree() { return *reinterpret_cast<NodeMemBlock**>(&buf_[0]); }
+    };
+    static_assert(N >= (int)sizeof(void*), "node must be able to hold a free list link");
+
+    // Заголовок сегмента
+    struct alignas(std::max_align_t) SegmentHeader {
+        StlListAllocCache* owner_;  // кэш, из которого выделяются блоки сегмента
     };
 
-    // кэш
-    std::vector<NodeMemBlock*> v_;
+    enum { kSegmentBytes = StlListAllocSegmentBytes(sizeof(SegmentHeader) + kMinSegmentNodes * sizeof(NodeMemBlock)) };
+    enum { kSegmentNodes = (kSegmentBytes - sizeof(SegmentHeader)) / sizeof(NodeMemBlock) }; // число блоков в сегменте
+
+    struct Chunk {
+        uint8_t* mem_;
+        size_t segmentNum_;
+    };
 
-    StlListAllocCache() {}
+    // Владелец кэша потока: при завершении потока отказывается от кэша (@see Abandon())
+    struct ThreadHolder {
+        ThreadHolder() { tlsCache_ = Create(); }
+        ~ThreadHolder() {
+            StlListAllocCache* cache = tlsCache_;
+            tlsCache_ = 0; // дальнейшие освобождения в этом потоке идут как удаленные
+            cache->Abandon();
+        }
+    };
+
+    std::vector<Chunk> chunks_;     // куски блоков, последний - текущий
+    NodeMemBlock* freeList_;        // голова списка возвращенных блоков
+    NodeMemBlock* bump_;            // первый ни разу не выданный блок текущего сегмента
+    NodeMemBlock* bumpEnd_;         // конец блоков текущего сегмента
+    uint8_t* nextSegment_;          // следующий ни разу не использованный сегмент текущего куска
+    uint8_t* chunkEnd_;             // конец текущего куска
+    size_t nextChunkSegments_;      // число сегментов в следующем куске
+    PageArena* arena_;  // арена страниц, из которой выделяются куски, 0 - куча
+    uint nodeNum_;      // число выданных и еще не принятых назад блоков
+    AllocStats stats_;  // счетчики кэша
+    Trace& trace_;      // политика трассировки (@see StlListAllocTraceInstance())
+
+    // поля, которые меняют чужие потоки, - на отдельной строке кэша
+    alignas(64) std::atomic<NodeMemBlock*> remoteFree_; // стек блоков, освобожденных в чужих потоках
+    /* Пока поток-владелец жив - kOwnerAlive плюс принятые и минус учтенные удаленные освобождения. Блок может быть
+    принят владельцем раньше, чем освободивший поток его учтет, поэтому значение колеблется около kOwnerAlive,
+    но не опускается до единицы. После завершения потока - число блоков, которые еще не освобождены.
+    Кто доводит его до нуля, тот уничтожает кэш.
+    */
+    std::atomic<int64_t> pending_;
+    static const int64_t kOwnerAlive = int64_t(1) << 62;
+
+    static thread_local StlListAllocCache* tlsCache_;
+
+    StlListAllocCache() : freeList_(0), bump_(0), bumpEnd_(0), nextSegment_(0), chunkEnd_(0),
+        nextChunkSegments_(1), arena_(0), nodeNum_(0),
+        stats_("StlListAllocCache", sizeof(NodeMemBlock)), trace_(StlListAllocTraceInstance<Trace>()),
+        remoteFree_(0), pending_(kOwnerAlive) {
+        char name[32];
+        snprintf(name, sizeof(name), "class %d bytes", N);
+        stats_.SetName(name);
+    }
     StlListAllocCache(const StlListAllocCache& oth);
     StlListAllocCache& operator=(const StlListAllocCache& oth);
-    static wxSharedPtr<StlListAllocCache<N> > singleton_;
+
+    ~StlListAllocCache() {
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            FreeChunk(chunks_[i]);
+        }
+    }
+
+    // Кэш выровнен по строке кэша, а new в C++11 не учитывает расширенное выравнивание
+    static StlListAllocCache* Create() {
+        void* raw = AlignedAlloc(sizeof(StlListAllocCache), alignof(StlListAllocCache));
+        if (raw == 0) throw std::bad_alloc();
+        return new(raw) StlListAllocCache();
+    }
+
+    void Destroy() {
+        this->~StlListAllocCache();
+        AlignedFree(this);
+    }
+
+    // Выделить новый кусок, следующий по размеру, и сделать его текущим
+    void AddChunk() {
+        size_t bytes = nextChunkSegments_ * kSegmentBytes;
+        void* raw = (arena_ != 0) ? arena_->Alloc(bytes, kSegmentBytes) : AlignedAlloc(bytes, kSegmentBytes);
+        if (raw == 0) throw std::bad_alloc();
+        Chunk chunk = { static_cast<uint8_t*>(raw), nextChunkSegments_ };
+        chunks_.push_back(chunk);
+        nextSegment_ = chunk.mem_;
+        chunkEnd_ = chunk.mem_ + bytes;
+        stats_.OnReserve(bytes);
+        if (nextChunkSegments_ < kMaxChunkSegments) nextChunkSegments_ *= 2;
+    }
+
+    void FreeChunk(const Chunk& chunk) {
+        size_t bytes = chunk.segmentNum_ * kSegmentBytes;
+        if (arena_ != 0) {
+            arena_->Free(chunk.mem_, bytes, kSegmentBytes);
+        }
+        else {
+            AlignedFree(chunk.mem_);
+        }
+        stats_.OnRelease(bytes);
+    }
+
+    // Начать выдачу блоков из следующего сегмента, выделив при необходимости новый кусок
+    void NextSegment() {
+        if (nextSegment_ == chunkEnd_) AddChunk();
+        SegmentHeader* header = reinterpret_cast<SegmentHeader*>(nextSegment_);
+        header->owner_ = this;
+        bump_ = reinterpret_cast<NodeMemBlock*>(header + 1);
+        bumpEnd_ = bump_ + kSegmentNodes;
+        nextSegment_ += kSegmentBytes;
+    }
+
+    // Заголовок сегмента, в котором лежит блок
+    static SegmentHeader* SegmentOf(const void* p) {
+        return reinterpret_cast<SegmentHeader*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(kSegmentBytes - 1));
+    }
+
+    static StlListAllocCache* CreateThreadCache() {
+        static thread_local ThreadHolder holder;
+        return tlsCache_;
+    }
+
+    // Вернуть блок в список свободных блоков (поток-владелец)
+    void FreeLocal(NodeMemBlock* mem) {
+        mem->NextFree() = freeList_;
+        freeList_ = mem;
+        --nodeNum_;
+        stats_.OnFree();
+    }
+
+    // Положить блок в стек удаленных освобождений (чужой поток)
+    void FreeRemote(NodeMemBlock* mem) {
+        NodeMemBlock* head = remoteFree_.load(std::memory_order_relaxed);
+        do {
+            mem->NextFree() = head;
+        } while (!remoteFree_.compare_exchange_weak(head, mem, std::memory_order_release, std::memory_order_relaxed));
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy(); // поток-владелец завершился, и это был последний выданный блок
+        }
+    }
+
+    // Принять блоки, освобожденные в чужих потоках, в список свободных блоков
+    void AcceptRemote() {
+        NodeMemBlock* mem = remoteFree_.exchange(0, std::memory_order_acquire);
+        int64_t n = 0;
+        while (mem != 0) {
+            NodeMemBlock* next = mem->NextFree();
+            trace_.OnDeallocate(mem, N);
+            FreeLocal(mem);
+            mem = next;
+            ++n;
+        }
+        pending_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Поток-владелец завершается: уничтожить кэш сейчас или оставить его последнему освобождающему
+    void Abandon() {
+        AcceptRemote();
+        trace_.OnCacheDestroy(nodeNum_);
+        int64_t delta = int64_t(nodeNum_) - kOwnerAlive;
+        if (pending_.fetch_add(delta, std::memory_order_acq_rel) + delta == 0) {
+            Destroy();
+        }
+    }
+
 public:
-    static StlListAllocCache<N>& Instance() {
-        if (singleton_.get() == 0) {
-            singleton_ = wxSharedPtr<StlListAllocCache<N> >(new StlListAllocCache<N>());
+    /** @brief Кэш вызывающего потока, создается при первом обращении потока.
+    @note в потоке, деструкторы thread_local объектов которого уже отработали, узлы можно только освобождать.
+    */
+    static StlListAllocCache<N, Trace>& Instance() {
+        StlListAllocCache* cache = tlsCache_;
+        if (cache == 0) {
+            cache = CreateThreadCache();
         }
-        return *singleton_;
+        return *cache;
     }
 
-    ~StlListAllocCache() {
-        ClearCache();
-#ifdef YADSL_LISTALLOCATOR_DEBUG
-#ifdef YADSL_LISTALLOCATOR_DEBUG_USE_MSGBOX
-        wchar_t buf[128];
-        wsprintf(buf, L"~StlListAllocCache(%d)\n", N);
-        MessageBoxW(0, buf, L"[yadsl, stl list allocator]:", MB_TOPMOST | MB_OK);
-#endif
+    /** @brief Брать куски блоков узлов из арены страниц (@see PageArena) вместо кучи, 0 - снова из кучи.
+    Допускается, только пока у кэша нет ни одного куска. Арена должна пережить кэш и не должна использоваться
+    другими потоками: кэш, блоки которого пережили свой поток, возвращает куски в арену из потока последнего освобождения.
+    */
+    void SetArena(PageArena* arena) {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT_MSG(chunks_.empty(), wxT("arena can be changed only before the first allocation"));
 #endif
+        arena_ = arena;
     }
+
+    /// Счетчики кэша (@see AllocStats)
+    const AllocStats& Stats() const { return stats_; }
+
     // Выделить блок памяти для узла списка
     void* AllocateNode(){
 
-        if (v_.empty()) {
-            v_.push_back(new NodeMemBlock());
+        if (freeList_ == 0 && remoteFree_.load(std::memory_order_relaxed) != 0) {
+            AcceptRemote();
         }
-        NodeMemBlock* mem = v_.back();
-#ifdef YADSL_LISTALLOCATOR_DEBUG
-        printf("%s allocated mem block markered byte contains:%X\n", yadsl_private::stlListAllocReporter, (int)(*mem->MarkZone()));
-#endif
-        v_.pop_back();
+        NodeMemBlock* mem = freeList_;
+        if (mem != 0) {
+            freeList_ = mem->NextFree();
+            stats_.OnAlloc(true);
+        }
+        else {
+            bool fCacheHit = (bump_ != bumpEnd_ || nextSegment_ != chunkEnd_);
+            if (bump_ == bumpEnd_) NextSegment();
+            mem = new(bump_++) NodeMemBlock();
+            stats_.OnAlloc(fCacheHit);
+        }
+        ++nodeNum_;
+        trace_.OnAllocate(mem, N);
         return static_cast<void*>(&mem->buf_[0]);
     }
 
-    // Освободить выделенную ранее для узла списка память
-    void DeallocateNode(void* p){
+    /** @brief Освободить выделенную ранее для узла списка память.
+    Блок возвращается в кэш, из которого выделен, в том числе кэш другого потока (@see StlListAllocCache).
+    */
+    static void DeallocateNode(void* p){
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT(p != 0);
 #endif
         NodeMemBlock* mem = static_cast<NodeMemBlock*>(p);
-#ifdef YADSL_LISTALLOCATOR_DEBUG
-        printf("%s deallocated mem block markered byte contains:%X\n", yadsl_private::stlListAllocReporter, (int)(*mem->MarkZone()));
-#endif
 #ifdef YADSL_USE_WXDEBUG
         wxASSERT_MSG(mem->Marked(), wxT("Its seems you trying deallocate mem which is not allocated by this allocator\n or it was writing out of allocated range"));
 #endif
-        v_.push_back(mem);
+        StlListAllocCache* owner = SegmentOf(mem)->owner_;
+        if (owner == tlsCache_) {
+            owner->trace_.OnDeallocate(mem, N);
+            owner->FreeLocal(mem);
+        }
+        else {
+            owner->FreeRemote(mem);
+        }
     }
 
-    // Очистить кэш блоков памяти узлов списка
+    /** @brief Очистить кэш блоков памяти узлов списка: вернуть куски в кучу (арену).
+    Куски возвращаются, только если ни один блок не выдан, иначе кэш не меняется.
+    Следующие куски снова растут с наименьшего размера. Вызывается потоком-владельцем.
+    */
     void ClearCache(){
-#ifdef YADSL_LISTALLOCATOR_DEBUG
-        int cElem = 0;
-#endif
-        while (!v_.empty()){
-            NodeMemBlock* mem = v_.back();
-            v_.pop_back();
-            delete mem;
-#ifdef YADSL_LISTALLOCATOR_DEBUG
-            cElem++;
-#endif
+        AcceptRemote();
+        if (nodeNum_ != 0) {
+            return;
         }
-#ifdef YADSL_LISTALLOCATOR_DEBUG
-        printf("%s yadsl Stl cache cleaned. Cache size was: %d elements\n", yadsl_private::stlListAllocReporter, cElem);
-#endif
+        for (size_t i = 0; i < chunks_.size(); ++i) {
+            FreeChunk(chunks_[i]);
+        }
+        chunks_.clear();
+        freeList_ = bump_ = bumpEnd_ = 0;
+        nextSegment_ = chunkEnd_ = 0;
+        nextChunkSegments_ = 1;
     }
+
+    /// Число выданных и не возвращенных блоков (возвращенные чужими потоками учитываются при приеме)
+    uint NodeNum() const { return nodeNum_; }
 };
 
-template <int N>
-wxSharedPtr<StlListAllocCache<N> > StlListAllocCache<N>::singleton_;
+template <int N, typename Trace>
+thread_local StlListAllocCache<N, Trace>* StlListAllocCache<N, Trace>::tlsCache_ = 0;
+
+//-----------------------------------------------------------------------------
+
+/** @brief Кэш массивов для StlListAllocator: запросы больше одного элемента (массивы корзин std::unordered_map и т.п.).
+
+Размер массива округляется вверх до степени двойки от kMinBytes до kMaxBytes байт, у каждого класса размера
+свой список свободных массивов, звенья которого хранятся в самих массивах. Массивы больше kMaxBytes и с выравниванием
+больше alignof(std::max_align_t) выделяются из кучи напрямую. Кэш свой у каждого потока; массив можно освободить
+в любом потоке, тогда он попадает в кэш освобождающего потока. При завершении потока его кэш возвращает массивы в кучу.
+Массивы запрашиваются редко (при росте контейнера), поэтому кэш не выделяет их кусками.
+*/
+class StlArrayAllocCache {
+private:
+    enum { kMinShift = 4, kMaxShift = 16 };
+    enum { kClassNum = kMaxShift - kMinShift + 1 };
+
+    struct FreeArray {
+        FreeArray* next_;
+    };
+
+    // Состояние потока, тривиально уничтожаемое: доступно и после уничтожения кэша потока
+    struct TlsState {
+        StlArrayAllocCache* cache_;
+        bool fExited_;              // кэш потока уже уничтожен
+    };
+
+    // Владелец кэша потока
+    struct ThreadHolder {
+        ThreadHolder() { Tls().cache_ = new StlArrayAllocCache(); }
+        ~ThreadHolder() {
+            TlsState& tls = Tls();
+            delete tls.cache_;
+            tls.cache_ = 0;
+            tls.fExited_ = true;
+        }
+    };
+
+    FreeArray* free_[kClassNum];    // списки свободных массивов по классам размера
+    AllocStats stats_;
+
+    // Класс размера для bytes <= kMaxBytes
+    static uint ClassOf(size_t bytes) {
+        uint c = 0;
+        while ((size_t(1) << (c + kMinShift)) < bytes) ++c;
+        return c;
+    }
+
+    static TlsState& Tls() {
+        static thread_local TlsState tls = { 0, false };
+        return tls;
+    }
+
+    // Кэш вызывающего потока, 0 - кэш потока уже уничтожен
+    static StlArrayAllocCache* Instance() {
+        TlsState& tls = Tls();
+        if (tls.cache_ == 0 && !tls.fExited_) {
+            static thread_local ThreadHolder holder;
+        }
+        return tls.cache_;
+    }
+
+    static bool Cacheable(size_t bytes, size_t alignment) {
+        return bytes <= kMaxBytes && alignment <= alignof(std::max_align_t);
+    }
+
+    StlArrayAllocCache() : stats_("StlArrayAllocCache", 0) {
+        for (uint c = 0; c < kClassNum; ++c) free_[c] = 0;
+    }
+
+    ~StlArrayAllocCache() {
+        for (uint c = 0; c < kClassNum; ++c) {
+            while (free_[c] != 0) {
+                FreeArray* a = free_[c];
+                free_[c] = a->next_;
+                AlignedFree(a);
+            }
+        }
+    }
+
+    StlArrayAllocCache(const StlArrayAllocCache&);
+    StlArrayAllocCache& operator=(const StlArrayAllocCache&);
+
+public:
+    enum { kMinBytes = 1 << kMinShift };    ///< наименьший класс размера
+    enum { kMaxBytes = 1 << kMaxShift };    ///< наибольший класс размера, массивы больше выделяются из кучи напрямую
+
+    /** @brief Выделить массив.
+    @param bytes размер массива.
+    @param alignment выравнивание массива.
+    */
+    static void* Allocate(size_t bytes, size_t alignment) {
+        if (!Cacheable(bytes, alignment)) {
+            void* p = AlignedAlloc(bytes, alignment);
+            if (p == 0) throw std::bad_alloc();
+            return p;
+        }
+        uint c = ClassOf(bytes);
+        size_t classBytes = size_t(1) << (c + kMinShift);
+        StlArrayAllocCache* cache = Instance();
+        if (cache != 0) {
+            FreeArray* a = cache->free_[c];
+            if (a != 0) {
+                cache->free_[c] = a->next_;
+                cache->stats_.OnAlloc(true);
+                return a;
+            }
+        }
+        // массив выделяется размером класса и без кэша: его может освободить поток с живым кэшем и выдать снова
+        void* p = AlignedAlloc(classBytes, alignof(std::max_align_t));
+        if (p == 0) throw std::bad_alloc();
+        if (cache != 0) {
+            cache->stats_.OnAlloc(false);
+            cache->stats_.OnReserve(classBytes);
+        }
+        return p;
+    }
+
+    /// Освободить массив, bytes и alignment - те же, что при выделении
+    static void Deallocate(void* p, size_t bytes, size_t alignment) {
+        StlArrayAllocCache* cache = Cacheable(bytes, alignment) ? Instance() : 0;
+        if (cache == 0) {
+            AlignedFree(p); // массивы кэша выделены из кучи целиком, их тоже можно вернуть напрямую
+            return;
+        }
+        uint c = ClassOf(bytes);
+        FreeArray* a = static_cast<FreeArray*>(p);
+        a->next_ = cache->free_[c];
+        cache->free_[c] = a;
+        cache->stats_.OnFree();
+    }
+};
 
 //-----------------------------------------------------------------------------
 
@@ -139,8 +643,17 @@ class StlListAllocNumException: public std::exception {
     }
 };
 
-/** @brief Аллокатор для списка stl. */
-template <typename LT>
+/** @brief Аллокатор для узловых контейнеров stl: std::list, std::map, std::set, std::multimap, std::unordered_map и т.п.
+
+Запросы одного элемента (узлы) обслуживает кэш узлов StlListAllocCache, запросы массивов (корзины хэш-таблиц) -
+кэш массивов StlArrayAllocCache.
+@code
+std::multimap<uint, Item, std::less<uint>, yadsl::StlListAllocator<std::pair<const uint, Item> > > items;
+@endcode
+@param Trace политика трассировки узлов (@see StlListAllocNullTrace). Кэш узлов общий для всех контейнеров потока
+с тем же классом размера узла и политикой.
+*/
+template <typename LT, typename Trace = StlListAllocNullTrace>
 class StlListAllocator {
 private:
 
@@ -155,11 +668,11 @@ public:
 	typedef const LT& const_reference;
 	typedef LT value_type;
 
-	/* Таким образом, rebind<T_OTH>::other - это StlListAllocator<T_OTH>
+	/* Таким образом, rebind<T_OTH>::other - это StlListAllocator<T_OTH, Trace>
 	*/
 	template<typename T_OTH>
 	struct rebind{
-		typedef StlListAllocator<T_OTH> other;
+		typedef StlListAllocator<T_OTH, Trace> other;
 	};
 
 	/* Конструкторы и деструктор, которые ничего не делают,
@@ -170,7 +683,7 @@ public:
     StlListAllocator(const StlListAllocator& oth) throw() { }
 
 	template<typename T_OTH>
-	StlListAllocator(const StlListAllocator<T_OTH>&) throw() { }
+	StlListAllocator(const StlListAllocator<T_OTH, Trace>&) throw() { }
 
 	~StlListAllocator() throw() { }
 
@@ -179,20 +692,25 @@ public:
 	const_pointer address(const_reference r) const noexcept { return std::addressof(r); }
 
 	pointer allocate(size_type num, const void* = 0) {
-		if (num > 1 || num > this->max_size())
+		if (num > this->max_size())
 			throw StlListAllocNumException();
-#if YADSL_LISTALLOCATOR_DEBUG
-        printf("%s allocated %d elements of size %d bytes\n", yadsl_private::stlListAllocReporter, num, sizeof(LT));
-#endif
-        void* raw = StlListAllocCache<sizeof(LT)>::Instance().AllocateNode();
+        void* raw = 0;
+        if (num == 1 && alignof(LT) <= alignof(std::max_align_t)) {
+            raw = StlListAllocCache<StlListAllocSizeClass(sizeof(LT)), Trace>::Instance().AllocateNode();
+        }
+        else {
+            raw = StlArrayAllocCache::Allocate(num * sizeof(LT), alignof(LT));
+        }
         return static_cast<LT*> (raw);
 	}
 
-	void deallocate(pointer p, size_type) {
-	    StlListAllocCache<sizeof(LT)>::Instance().DeallocateNode(p);
-#if YADSL_LISTALLOCATOR_DEBUG
-        printf("%s deallocated element\n", yadsl_private::stlListAllocReporter);
-#endif
+	void deallocate(pointer p, size_type num) {
+        if (num == 1 && alignof(LT) <= alignof(std::max_align_t)) {
+            StlListAllocCache<StlListAllocSizeClass(sizeof(LT)), Trace>::DeallocateNode(p);
+        }
+        else {
+            StlArrayAllocCache::Deallocate(p, num * sizeof(LT), alignof(LT));
+        }
     }
 
 	/// Возвращает максимальное количество элементов, для которых может быть выделена память
@@ -212,20 +730,12 @@ public:
 
 };
 
-template<typename T1, typename T2>
-inline bool operator==(const StlListAllocator<T1>&, const StlListAllocator<T2>&) noexcept
+template<typename T1, typename T2, typename Trace>
+inline bool operator==(const StlListAllocator<T1, Trace>&, const StlListAllocator<T2, Trace>&) noexcept
 { return true; }
 
-template<typename LT>
-inline bool operator==(const StlListAllocator<LT>&, const StlListAllocator<LT>&) noexcept
-{ return true; }
-
-template<typename T1, typename T2>
-inline bool operator!=(const StlListAllocator<T1>&, const StlListAllocator<T2>&) noexcept
-{ return false; }
-
-template<typename LT>
-inline bool operator!=(const StlListAllocator<LT>&, const StlListAllocator<LT>&) noexcept
+template<typename T1, typename T2, typename Trace>
+inline bool operator!=(const StlListAllocator<T1, Trace>&, const StlListAllocator<T2, Trace>&) noexcept
 { return false; }
 
 
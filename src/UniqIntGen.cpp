@@ -13,19 +13,13 @@ UniqIntGenerator::~UniqIntGenerator() {
 #endif
 }
 
-void UniqIntGenerator::Generate() {
-    wxASSERT(generated_.empty());
-    generated_.push_back(num_++);
-}
-
 uint UniqIntGenerator::Get() {
-    if (generated_.empty()) {
-        Generate();
+    if (unused_.Empty()) {
+        uint n = num_++;
+        OnGenerated();
+        return n;
     }
-    wxASSERT(!generated_.empty());
-    uint n = generated_.back();
-    generated_.pop_back();
-    return n;
+    return unused_.PopLowest();
 }
 
 bool UniqIntGenerator::Put(uint n) {
@@ -37,45 +31,95 @@ bool UniqIntGenerator::Put(uint n) {
         return false;
     }
 
-    std::vector<uint>::iterator pos = std::lower_bound(generated_.begin(), generated_.end(), n);
-    if (pos != generated_.end()) {
-        if (*pos > n) {
-            generated_.insert(pos, n);
-            return true;
-        }
-        else /* pos == n */ {
+    if (!unused_.Insert(n)) {
 #ifdef YADSL_USE_WXDEBUG
-            wxASSERT(*pos == n); // case *pos < n  is unreachable, check it
-            wxFAIL_MSG(wxT("duplicate inserting detected"));
+        wxFAIL_MSG(wxT("duplicate inserting detected"));
 #endif
-            return false;
-        }
+        return false;
     }
-    // все числа в контейнере меньше, чем вставляемое
-    generated_.push_back(n);
+    OnPut(n);
     return true;
 }
 
+void UniqIntGenerator::GetRange(uint n, uint* out) {
+    uint count = unused_.PopLowest(out, n);
+    while (count < n) {
+        out[count++] = num_++;
+    }
+    OnGenerated();
+}
+
+uint UniqIntGenerator::PutMany(const uint* first, const uint* last, uint* inserted) {
+    sortBuf_.assign(first, last);
+    std::sort(sortBuf_.begin(), sortBuf_.end());
+    // числа >= num_ не генерировались, отбрасываем их с конца
+    std::vector<uint>::iterator valid = std::lower_bound(sortBuf_.begin(), sortBuf_.end(), num_);
+    size_t cValid = valid - sortBuf_.begin();
+    uint count = 0;
+    if (cValid != 0) {
+        // вставленные числа записываются в начало sortBuf_: поколение увеличивается только у действительно
+        // возвращенных идентификаторов, по одному разу, даже если идентификатор повторяется в пачке
+        count = unused_.InsertSorted(&sortBuf_[0], &sortBuf_[0] + cValid, &sortBuf_[0]);
+        for (uint i = 0; i < count; ++i) {
+            OnPut(sortBuf_[i]);
+        }
+        if (inserted != 0) std::copy(sortBuf_.begin(), sortBuf_.begin() + count, inserted);
+    }
+#ifdef YADSL_USE_WXDEBUG
+    wxASSERT_MSG(valid == sortBuf_.end(), wxT("out of range"));
+    wxASSERT_MSG(count == cValid, wxT("duplicate inserting detected"));
+#endif
+    sortBuf_.clear();
+    return count;
+}
+
+UniqIntGenerator::Handle UniqIntGenerator::GetHandle() {
+#ifdef YADSL_USE_WXDEBUG
+    wxASSERT(fGenerational_);
+#endif
+    uint n = Get();
+    return MakeHandle(n, generations_[n]);
+}
+
+bool UniqIntGenerator::PutHandle(Handle h) {
+    if (!IsAlive(h)) {
+#ifdef YADSL_USE_WXDEBUG
+        wxFAIL_MSG(wxT("stale handle"));
+#endif
+        return false;
+    }
+    return Put(HandleIndex(h));
+}
+
 #if YADSL_TRACE_UNIQINTGENERATOR
+// Вывод отрезков неиспользуемых чисел через запятую
+struct TraceRunPrinter {
+    bool fFirst_;
+
+    TraceRunPrinter() : fFirst_(true) {}
+    void operator()(uint lo, uint hi) {
+        printf("%s", fFirst_ ? "" : ", ");
+        if (hi - lo == 1) printf("%d", lo);
+        else printf("%d-%d", lo, hi - 1);
+        fFirst_ = false;
+    }
+};
+
 void UniqIntGenerator::TraceToConsole(bool fShowMemAddressOfInstance) {
     printf("UniqIntGenerator %s%x%s -- %d: ",
            fShowMemAddressOfInstance ? "(" : "",
            (int)this,
            fShowMemAddressOfInstance ? ")" : "",
            num_);
-    for (uint i = 0; i < Unused(); i++) {
-        printf("%d%s ", Data()[i], (i == Unused() -1) ? ".\n" : ",");
-    }
-    if (Unused() == 0) printf("\n");
+    TraceRunPrinter printer;
+    unused_.ForEachRun(printer);
+    printf("%s\n", Unused() == 0 ? "" : ".");
 }
 #endif
 
 #if YADSL_TEST_UNIQINTGENERATOR
 bool UniqIntGenerator::IsValidWhenAllPutBack() const {
-    for (size_t i = 0; i < generated_.size(); i++) {
-        if (generated_[i] != i) return false;
-    }
-    return true;
+    return unused_.IsPrefix();
 }
 #endif
 
@@ -6,6 +6,14 @@
 #define YADSL_TEST_UNIQINTGENERATOR 1 ///< флаг включения теста для класса генерации уникальных чисел
 #include <vector>
 #include "BaseTypes.h"
+#ifdef YADSL_USE_BITMAP_IN_UNIQINTGENERATOR
+#include "IntBitmapSet.h"
+#else
+#include "IntRunSet.h"
+#endif
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
 
 namespace yadsl
 {
@@ -24,21 +32,70 @@ uint n = uig.Get();
 //...
 uig.Put(n);
 @endcode
+
+Для массовой выдачи и возврата идентификаторов (волна порождения или уничтожения сущностей) следует использовать
+GetRange() и PutMany(): они обходятся одним проходом по хранилищу неиспользуемых идентификаторов вместо
+поштучных вызовов.
+@code
+uint ids[1000];
+uig.GetRange(1000, ids);
+//...
+uig.PutMany(ids, ids + 1000);
+@endcode
+
+###Поколения###
+Генератор, созданный с флагом fGenerational, ведет для каждого идентификатора счетчик поколений, который
+увеличивается при каждом возврате идентификатора. GetHandle() выдает упакованный дескриптор {индекс, поколение},
+IsAlive() за O(1) проверяет, не был ли идентификатор возвращен (и, возможно, выдан заново) после выдачи дескриптора.
+@code
+UniqIntGenerator uig(true);
+UniqIntGenerator::Handle h = uig.GetHandle();
+uig.PutHandle(h);
+uint n = uig.Get(); // n == UniqIntGenerator::HandleIndex(h), но uig.IsAlive(h) == false
+@endcode
+
+Get() выдает наименьший неиспользуемый идентификатор, поэтому идентификаторы остаются плотными, а массивы,
+индексируемые ими, - компактными.
+
+###Сборка###
+По умолчанию неиспользуемые идентификаторы хранятся в виде слитых отрезков (@see IntRunSet): возврат и выдача
+идентификатора выполняются за логарифмическое от числа отрезков время, а расход памяти не зависит от числа
+возвращенных идентификаторов.
+Макрос YADSL_USE_BITMAP_IN_UNIQINTGENERATOR отвечает за реализацию на основе многоуровневой битовой карты
+(@see IntBitmapSet): выдача и возврат идентификатора - за число уровней карты, расход памяти - бит на идентификатор.
+Выгодна при миллионах идентификаторов с сильно перемешанными возвратами.
 */
 class UniqIntGenerator {
 private:
-    std::vector<uint> generated_;
-    uint num_;
+#ifdef YADSL_USE_BITMAP_IN_UNIQINTGENERATOR
+    typedef IntBitmapSet UnusedSet;
+#else
+    typedef IntRunSet UnusedSet;
+#endif
 
-    // Доступ к контейнеру с идентификаторами
-    const uint* Data() const { return &generated_[0]; }
+    UnusedSet unused_;  // неиспользуемые ранее сгенерированные идентификаторы
+    uint num_;
+    std::vector<uint> sortBuf_; // буфер для сортировки возвращаемых пачкой идентификаторов
+    bool fGenerational_;        // ведутся ли поколения идентификаторов
+    std::vector<uint> generations_; // текущее поколение каждого сгенерированного идентификатора
 
-    // генерация нового числа
-    void Generate();
+    // Учет поколений при выдаче нового и возврате идентификатора
+    void OnGenerated() { if (fGenerational_) generations_.resize(num_, 1); }
+    void OnPut(uint n) { if (fGenerational_ && ++generations_[n] == 0) generations_[n] = 1; }
 
 public:
-
-    UniqIntGenerator() : num_(0) {}
+    /// Упакованный дескриптор: младшие 32 бита - идентификатор (индекс), старшие - поколение
+    typedef uint64_t Handle;
+    enum { /** @brief Недопустимое значение дескриптора (поколения начинаются с 1). */ kNoHandle = 0 };
+
+    /// Собрать дескриптор из индекса и поколения
+    static Handle MakeHandle(uint index, uint generation) { return (Handle(generation) << 32) | index; }
+    /// Индекс (идентификатор) дескриптора
+    static uint HandleIndex(Handle h) { return uint(h); }
+    /// Поколение дескриптора
+    static uint HandleGeneration(Handle h) { return uint(h >> 32); }
+
+    explicit UniqIntGenerator(bool fGenerational = false) : num_(0), fGenerational_(fGenerational) {}
     ~UniqIntGenerator();
 
     /// Получить новый уникальный или неиспользуемый идентификатор
@@ -46,8 +103,49 @@ public:
     /// Положить неиспользуемый идентификатор в буфер генератора
     bool Put(uint n);
 
+    /** @brief Получить n уникальных или неиспользуемых идентификаторов.
+
+    Сначала выдаются наименьшие неиспользуемые идентификаторы, недостающие генерируются
+    одним непрерывным отрезком.
+    @param out [out] массив не менее чем из n элементов, куда записываются идентификаторы.
+    */
+    void GetRange(uint n, uint* out);
+
+    /** @brief Положить пачку неиспользуемых идентификаторов [first, last) в буфер генератора.
+
+    Идентификаторы сортируются один раз и сливаются с буфером за один проход.
+    @param inserted [out] если не 0 - сюда по возрастанию записываются возвращенные идентификаторы
+    (не меньше last - first элементов).
+    @return число возвращенных идентификаторов (ошибочные и повторные пропускаются).
+    */
+    uint PutMany(const uint* first, const uint* last, uint* inserted = 0);
+
+    /// Ведутся ли поколения идентификаторов
+    bool IsGenerational() const { return fGenerational_; }
+
+    /** @brief Получить дескриптор нового уникального или неиспользуемого идентификатора.
+    @note только для генератора с поколениями.
+    */
+    Handle GetHandle();
+
+    /** @brief Вернуть идентификатор дескриптора в генератор.
+    @return false, если дескриптор устарел (идентификатор уже возвращен).
+    */
+    bool PutHandle(Handle h);
+
+    /** @brief Проверка за O(1), что идентификатор дескриптора не возвращался в генератор после выдачи дескриптора.
+    @note только для генератора с поколениями.
+    */
+    bool IsAlive(Handle h) const {
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(fGenerational_);
+#endif
+        uint index = HandleIndex(h);
+        return index < generations_.size() && generations_[index] == HandleGeneration(h);
+    }
+
     /// Число неиспользуемых в данное время ранее сгенерированных идентификаторов
-    uint Unused() const { return generated_.size(); }
+    uint Unused() const { return unused_.Size(); }
     /// Число сгенерированных идентификаторов (как используемых в настоящий момент, так и неиспользуемых)
     uint Num() const { return num_; }
 
@@ -0,0 +1,573 @@
+#ifndef YADSL_UNROLLEDLIST_H
+#define YADSL_UNROLLEDLIST_H
+
+#include <new>
+#include <iterator>
+#include <utility> // std::move(), std::forward()
+#include <cstddef> // ptrdiff_t
+#include <stdint.h> // uintptr_t
+#include <vector>
+
+#ifdef YADSL_USE_WXDEBUG
+#include <wx/wx.h>
+#endif
+
+#include "BaseTypes.h"
+#include "Utils.h"
+#include "ClassInstMemBlockPool.h"
+#include "AllocStats.h"
+
+/** @file UnrolledList.h.
+Развернутый двусвязный список: несколько элементов в одном узле.
+*/
+
+namespace yadsl
+{
+
+/** @brief Развернутый двусвязный список: узел хранит до K элементов и маску занятых ячеек.
+
+Узел занимает NodeLines строк кэша (по умолчанию две, соседние строки подтягивает аппаратная предвыборка),
+поэтому обход списка указателей дает один промах кэша на десяток элементов, а не на каждый, как у List.
+Узлы выделяются из пула слябами, узел выровнен по своему размеру.
+
+Элементы в узлах не сдвигаются, поэтому указатель на элемент (Handle) остается действительным до удаления элемента,
+а по нему за O(1) находится узел (по выравниванию) и ячейка. Вставка возможна только в начало и в конец: push_back()
+занимает ячейку за последней занятой ячейкой последнего узла, push_front() - перед первой занятой ячейкой первого узла.
+Когда порядок элементов не важен, push_any() занимает ячейку, освобожденную erase(): список помнит узлы со свободными
+ячейками, поэтому при вставках вперемешку с удалениями узлы остаются заполненными, а не редеют. Узел возвращается
+в пул, когда в нем не остается элементов.
+@code
+UnrolledList<Entity*, kPOD_LIST> owners;
+UnrolledList<Entity*, kPOD_LIST>::Handle pos = owners.push_any(entity);
+//...
+owners.erase(pos);
+@endcode
+@param T тип элемента.
+@param POD kPOD_LIST - деструкторы элементов не вызываются.
+@param NodeLines желаемый размер узла в строках кэша. Если в него не помещается ни одного элемента, узел вмещает один элемент.
+*/
+template <typename T, int POD = 0, uint NodeLines = 2>
+class UnrolledList {
+private:
+    static constexpr size_t Pow2AtLeast(size_t n, size_t p = 1) { return (p >= n) ? p : Pow2AtLeast(n, p * 2); }
+    static constexpr size_t AlignUpConst(size_t n, size_t alignment) { return (n + alignment - 1) / alignment * alignment; }
+
+    enum : size_t {
+        kHeaderBytes = AlignUpConst(2 * sizeof(void*) + sizeof(uint64_t) + sizeof(uint), alignof(T)), // связи, маска, позиция в partial_
+        kFitNum = (NodeLines * kCacheLineSize > kHeaderBytes) ? (NodeLines * kCacheLineSize - kHeaderBytes) / sizeof(T) : 0
+    };
+
+public:
+    enum : size_t {
+        kNodeCapacity = (kFitNum == 0) ? size_t(1) : (kFitNum > 64 ? size_t(64) : size_t(kFitNum)), ///< число ячеек в узле (K)
+        kNodeBytes = Pow2AtLeast(kHeaderBytes + kNodeCapacity * sizeof(T)) ///< размер и выравнивание узла
+    };
+
+private:
+    enum : uint64_t { kFullMask = (kNodeCapacity == 64) ? ~uint64_t(0) : (uint64_t(1) << (kNodeCapacity % 64)) - 1 };
+
+public:
+    /// Указатель на элемент, действителен до удаления элемента
+    typedef T* Handle;
+
+private:
+    struct alignas(kNodeBytes) Node {
+        Node* next_;
+        Node* prev_;
+        uint64_t mask_; // занятые ячейки
+        uint partialIndex_; // позиция в списке узлов со свободными ячейками, kNoIndex - узел заполнен
+        alignas(T) uint8_t slots_[kNodeCapacity * sizeof(T)];
+
+        T* Slot(uint i) { return reinterpret_cast<T*>(&slots_[0]) + i; }
+        const T* Slot(uint i) const { return reinterpret_cast<const T*>(&slots_[0]) + i; }
+        uint FirstSlot() const { return Ctz64(mask_); }
+        uint LastSlot() const { return 63 - Clz64(mask_); }
+    };
+
+public:
+    /** @brief Пул узлов, который могут делить несколько списков.
+    Пул должен пережить все списки, которые его используют. Пул не потокобезопасен.
+    */
+    class Pool {
+        ClassInstanceMemBlockPool<Node> pool_;
+
+        Pool(const Pool&);
+        Pool& operator=(const Pool&);
+
+    public:
+        /// @param slabSize число узлов в слябе (@see ClassInstanceMemBlockPool)
+        explicit Pool(uint slabSize = ClassInstanceMemBlockPool<Node>::kDefaultSlabSize) : pool_(slabSize) {
+            pool_.Stats().SetName("UnrolledList::Pool");
+        }
+
+        ~Pool() {
+#ifdef YADSL_USE_WXDEBUG
+            wxASSERT_MSG(pool_.LiveBlockNum() == 0, wxT("all lists must be destroyed before their node pool"));
+#endif
+        }
+
+        /// Выделить пустой узел
+        Node* Alloc() {
+            void* mem = pool_.Alloc();
+            if (mem == 0) throw std::bad_alloc();
+            Node* node = static_cast<Node*>(mem);
+            node->next_ = node->prev_ = 0;
+            node->mask_ = 0;
+            node->partialIndex_ = kNoIndex;
+            return node;
+        }
+
+        /// Вернуть узел в пул, элементы узла к этому моменту должны быть разрушены
+        void Free(Node* node) { pool_.Free(node); }
+
+        /// Вернуть пустые слябы в кучу (@see ClassInstanceMemBlockPool::Trim())
+        uint Trim(uint keepEmptySlabs = 0) { return pool_.Trim(keepEmptySlabs); }
+
+        /// Число узлов, выданных спискам
+        uint LiveNodeNum() const { return pool_.LiveBlockNum(); }
+        /// Счетчики пула (@see AllocStats)
+        AllocStats& Stats() { return pool_.Stats(); }
+    };
+
+private:
+    // Итератор по занятым ячейкам. Конец списка - нулевой узел.
+    template <typename V>
+    class IteratorT {
+        friend class UnrolledList<T, POD, NodeLines>;
+        template <typename V2> friend class IteratorT;
+
+        Node* node_;
+        uint slot_;
+        const UnrolledList* list_;
+
+        IteratorT(Node* node, uint slot, const UnrolledList* list) : node_(node), slot_(slot), list_(list) {}
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        IteratorT() : node_(0), slot_(0), list_(0) {}
+        /// iterator приводится к const_iterator
+        template <typename V2>
+        IteratorT(const IteratorT<V2>& oth) : node_(oth.node_), slot_(oth.slot_), list_(oth.list_) {}
+
+        reference operator*() const { return *node_->Slot(slot_); }
+        pointer operator->() const { return node_->Slot(slot_); }
+
+        IteratorT& operator++() {
+            uint64_t higher = (slot_ < 63) ? node_->mask_ & (~uint64_t(0) << (slot_ + 1)) : 0;
+            if (higher != 0) {
+                slot_ = Ctz64(higher);
+            }
+            else {
+                node_ = node_->next_;
+                slot_ = (node_ != 0) ? node_->FirstSlot() : 0;
+            }
+            return *this;
+        }
+        IteratorT operator++(int) { IteratorT it(*this); ++*this; return it; }
+
+        IteratorT& operator--() {
+            uint64_t lower = (node_ != 0) ? node_->mask_ & ((uint64_t(1) << slot_) - 1) : 0;
+            if (lower != 0) {
+                slot_ = 63 - Clz64(lower);
+            }
+            else {
+                node_ = (node_ != 0) ? node_->prev_ : list_->last_;
+                slot_ = node_->LastSlot();
+            }
+            return *this;
+        }
+        IteratorT operator--(int) { IteratorT it(*this); --*this; return it; }
+
+        template <typename V2>
+        bool operator==(const IteratorT<V2>& oth) const { return node_ == oth.node_ && slot_ == oth.slot_; }
+        template <typename V2>
+        bool operator!=(const IteratorT<V2>& oth) const { return !(*this == oth); }
+    };
+
+public:
+    typedef T value_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef IteratorT<T> iterator;
+    typedef IteratorT<const T> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    Pool* pool_;        // пул узлов, 0 - собственный пул еще не создан
+    bool fOwnPool_;     // пул создан списком и уничтожается вместе с ним
+    Node* first_;
+    Node* last_;
+    size_t num_;        // число элементов
+    size_t nodeNum_;    // число узлов
+    std::vector<Node*> partial_; // узлы со свободными ячейками, последний - кандидат для push_any()
+
+    Pool& GetPool() {
+        if (pool_ == 0) {
+            pool_ = new Pool();
+            fOwnPool_ = true;
+        }
+        return *pool_;
+    }
+
+    // Узел, которому принадлежит элемент: узлы выровнены по своему размеру
+    static Node* NodeOf(const T* p) {
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(kNodeBytes - 1));
+    }
+
+    static uint SlotOf(Node* node, const T* p) { return uint(p - node->Slot(0)); }
+
+    // Сконструировать элемент в ячейке slot узла node; если узел новый и конструктор бросил исключение, узел возвращается в пул
+    template <typename... Args>
+    Handle Construct(Node* node, uint slot, bool fNewNode, Args&&... args) {
+        T* p = node->Slot(slot);
+        try {
+            new((void*)p) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            if (fNewNode) {
+                UnlinkNode(node);
+                pool_->Free(node);
+            }
+            throw;
+        }
+        node->mask_ |= uint64_t(1) << slot;
+        ++num_;
+        UpdatePartial(node);
+        return p;
+    }
+
+    // Включить узел в partial_ или исключить из него после изменения маски
+    void UpdatePartial(Node* node) {
+        bool fPartial = (node->mask_ != kFullMask);
+        if (fPartial == (node->partialIndex_ != kNoIndex)) return;
+        if (fPartial) {
+            node->partialIndex_ = uint(partial_.size());
+            partial_.push_back(node);
+        }
+        else {
+            RemovePartial(node);
+        }
+    }
+
+    // Исключить узел из partial_ за O(1): на его место встает последний
+    void RemovePartial(Node* node) {
+        Node* moved = partial_.back();
+        partial_[node->partialIndex_] = moved;
+        moved->partialIndex_ = node->partialIndex_;
+        partial_.pop_back();
+        node->partialIndex_ = kNoIndex;
+    }
+
+    void UnlinkNode(Node* node) {
+        if (node->next_ != 0) node->next_->prev_ = node->prev_;
+        else last_ = node->prev_;
+        if (node->prev_ != 0) node->prev_->next_ = node->next_;
+        else first_ = node->next_;
+        --nodeNum_;
+    }
+
+    void DestroyNodeData(Node* node) {
+        if (!POD) {
+            for (uint64_t m = node->mask_; m != 0; m &= m - 1) {
+                node->Slot(Ctz64(m))->~T();
+            }
+        }
+    }
+
+    UnrolledList(const UnrolledList&);
+    UnrolledList& operator=(const UnrolledList&);
+
+public:
+    /// Список с собственным пулом узлов, который создается при первой вставке
+    UnrolledList() : pool_(0), fOwnPool_(false), first_(0), last_(0), num_(0), nodeNum_(0) {}
+
+    /// Список, выделяющий узлы из общего пула
+    explicit UnrolledList(Pool& pool) : pool_(&pool), fOwnPool_(false), first_(0), last_(0), num_(0), nodeNum_(0) {}
+
+    /// Перемещение: узлы и пул переходят к новому списку, oth остается пустым
+    UnrolledList(UnrolledList&& oth) : pool_(oth.pool_), fOwnPool_(oth.fOwnPool_), first_(oth.first_), last_(oth.last_),
+        num_(oth.num_), nodeNum_(oth.nodeNum_), partial_(std::move(oth.partial_)) {
+        oth.partial_.clear();
+        if (fOwnPool_) oth.pool_ = 0;
+        oth.fOwnPool_ = false;
+        oth.first_ = oth.last_ = 0;
+        oth.num_ = oth.nodeNum_ = 0;
+    }
+
+    UnrolledList& operator=(UnrolledList&& oth) {
+        if (this != &oth) {
+            clear();
+            if (fOwnPool_) delete pool_;
+            pool_ = oth.pool_;
+            fOwnPool_ = oth.fOwnPool_;
+            first_ = oth.first_;
+            last_ = oth.last_;
+            num_ = oth.num_;
+            nodeNum_ = oth.nodeNum_;
+            partial_ = std::move(oth.partial_);
+            oth.partial_.clear();
+            if (fOwnPool_) oth.pool_ = 0;
+            oth.fOwnPool_ = false;
+            oth.first_ = oth.last_ = 0;
+            oth.num_ = oth.nodeNum_ = 0;
+        }
+        return *this;
+    }
+
+    ~UnrolledList() {
+        clear();
+        if (fOwnPool_) delete pool_;
+    }
+
+    bool empty() const { return num_ == 0; }
+    /// Число элементов, O(1)
+    size_t size() const { return num_; }
+    /// Число узлов списка
+    size_t NodeNum() const { return nodeNum_; }
+
+    Handle push_front(const T& data) { return emplace_front(data); }
+    Handle push_front(T&& data) { return emplace_front(std::move(data)); }
+    Handle push_back(const T& data) { return emplace_back(data); }
+    Handle push_back(T&& data) { return emplace_back(std::move(data)); }
+
+    /// Сконструировать элемент в начале списка из args
+    template <typename... Args>
+    Handle emplace_front(Args&&... args) {
+        if (first_ != 0 && first_->FirstSlot() > 0) {
+            return Construct(first_, first_->FirstSlot() - 1, false, std::forward<Args>(args)...);
+        }
+        Node* node = GetPool().Alloc();
+        node->next_ = first_;
+        if (first_ != 0) first_->prev_ = node;
+        else last_ = node;
+        first_ = node;
+        ++nodeNum_;
+        // новый узел заполняется от конца, чтобы следующие push_front() попадали в него же
+        return Construct(node, kNodeCapacity - 1, true, std::forward<Args>(args)...);
+    }
+
+    /// Сконструировать элемент в конце списка из args
+    template <typename... Args>
+    Handle emplace_back(Args&&... args) {
+        if (last_ != 0 && last_->LastSlot() + 1 < kNodeCapacity) {
+            return Construct(last_, last_->LastSlot() + 1, false, std::forward<Args>(args)...);
+        }
+        Node* node = GetPool().Alloc();
+        node->prev_ = last_;
+        if (last_ != 0) last_->next_ = node;
+        else first_ = node;
+        last_ = node;
+        ++nodeNum_;
+        return Construct(node, 0, true, std::forward<Args>(args)...);
+    }
+
+    Handle push_any(const T& data) { return emplace_any(data); }
+    Handle push_any(T&& data) { return emplace_any(std::move(data)); }
+
+    /** @brief Сконструировать элемент в любой свободной ячейке списка, когда порядок элементов не важен.
+    Сначала занимаются ячейки, освобожденные erase(); если свободных ячеек нет, работает как emplace_back().
+    */
+    template <typename... Args>
+    Handle emplace_any(Args&&... args) {
+        if (partial_.empty()) {
+            return emplace_back(std::forward<Args>(args)...);
+        }
+        Node* node = partial_.back();
+        return Construct(node, Ctz64(~node->mask_ & kFullMask), false, std::forward<Args>(args)...);
+    }
+
+    /// Удалить элемент за O(1). Опустевший узел возвращается в пул.
+    void erase(Handle h) {
+        Node* node = NodeOf(h);
+        uint slot = SlotOf(node, h);
+#ifdef YADSL_USE_WXDEBUG
+        wxASSERT(slot < kNodeCapacity && (node->mask_ & (uint64_t(1) << slot)) != 0);
+#endif
+        if (!POD) {
+            h->~T();
+        }
+        node->mask_ &= ~(uint64_t(1) << slot);
+        --num_;
+        if (node->mask_ == 0) {
+            if (node->partialIndex_ != kNoIndex) RemovePartial(node);
+            UnlinkNode(node);
+            pool_->Free(node);
+        }
+        else {
+            UpdatePartial(node);
+        }
+    }
+
+    /// Удалить элемент в pos, возвращает итератор на следующий элемент
+    iterator erase(const_iterator pos) {
+        iterator next(pos.node_, pos.slot_, this);
+        ++next;
+        erase(pos.node_->Slot(pos.slot_));
+        return next;
+    }
+
+    void pop_front() { erase(first_->Slot(first_->FirstSlot())); }
+    void pop_back() { erase(last_->Slot(last_->LastSlot())); }
+
+    /// Удалить все элементы, узлы возвращаются в пул
+    void clear() {
+        for (Node* node = first_; node != 0;) {
+            Node* next = node->next_;
+            DestroyNodeData(node);
+            pool_->Free(node);
+            node = next;
+        }
+        first_ = last_ = 0;
+        num_ = nodeNum_ = 0;
+        partial_.clear();
+    }
+
+    /// Пул узлов списка, собственный пул создается при первом обращении
+    Pool& GetNodePool() { return GetPool(); }
+    /// Счетчики пула узлов списка (@see AllocStats)
+    AllocStats& Stats() { return GetPool().Stats(); }
+
+    /// Итератор на элемент h
+    iterator iterator_to(Handle h) { Node* node = NodeOf(h); return iterator(node, SlotOf(node, h), this); }
+
+    T& front() { return *first_->Slot(first_->FirstSlot()); }
+    const T& front() const { return *first_->Slot(first_->FirstSlot()); }
+    T& back() { return *last_->Slot(last_->LastSlot()); }
+    const T& back() const { return *last_->Slot(last_->LastSlot()); }
+
+    iterator begin() { return iterator(first_, (first_ != 0) ? first_->FirstSlot() : 0, this); }
+    const_iterator begin() const { return const_iterator(first_, (first_ != 0) ? first_->FirstSlot() : 0, this); }
+    const_iterator cbegin() const { return begin(); }
+    iterator end() { return iterator(0, 0, this); }
+    const_iterator end() const { return const_iterator(0, 0, this); }
+    const_iterator cend() const { return end(); }
+
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    /** @brief Вызвать f(T&) для каждого элемента.
+    Быстрее обхода итератором: ячейки узла перебираются по маске без проверки перехода между узлами.
+    */
+    template <typename F>
+    void ForEach(F f) {
+        for (Node* node = first_; node != 0; node = node->next_) {
+            for (uint64_t m = node->mask_; m != 0; m &= m - 1) {
+                f(*node->Slot(Ctz64(m)));
+            }
+        }
+    }
+};
+
+} // end of yadsl
+
+//-----------------------------------------------------------------------------
+
+#if 0 // code for test/benchmark
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include "UnrolledList.h"
+#include "List.h"
+
+// Вставка, при которой порядок не важен: List - в конец, UnrolledList - в освобожденную ячейку
+template <typename T, int POD>
+typename yadsl::List<T, POD>::Node* InsertOwner(yadsl::List<T, POD>& l, const T& v) { return l.push_back(v); }
+template <typename T, int POD, uint NodeLines>
+T* InsertOwner(yadsl::UnrolledList<T, POD, NodeLines>& l, const T& v) { return l.push_any(v); }
+
+template <typename T, int POD>
+size_t NodeCount(const yadsl::List<T, POD>& l) { return l.size(); }
+template <typename T, int POD, uint NodeLines>
+size_t NodeCount(const yadsl::UnrolledList<T, POD, NodeLines>& l) { return l.NodeNum(); }
+
+// Обход списков владельцев после перемешивания вставок в несколько списков, как в Ec_Manager::owners_
+template <typename L, typename Handle>
+double BenchOwnerWalk(const char* name, L* lists, int listNum, std::vector<typename L::value_type>& entities) {
+    // узлы разных списков выделяются вперемешку, потом половина элементов удаляется и вставляется снова
+    std::mt19937 rnd(1);
+    std::vector<std::vector<Handle> > handles(listNum);
+    for (size_t i = 0; i < entities.size(); ++i) {
+        int k = rand() % listNum;
+        handles[k].push_back(lists[k].push_back(entities[i]));
+    }
+    for (int k = 0; k < listNum; ++k) {
+        std::shuffle(handles[k].begin(), handles[k].end(), rnd);
+        size_t half = handles[k].size() / 2;
+        for (size_t i = 0; i < half; ++i) {
+            lists[k].erase(handles[k][i]);
+        }
+        handles[k].erase(handles[k].begin(), handles[k].begin() + half);
+    }
+    for (size_t i = 0; i < entities.size() / 2; ++i) {
+        int k = rand() % listNum;
+        handles[k].push_back(InsertOwner(lists[k], entities[i]));
+    }
+    // долгая смена владельцев: случайные удаления вперемешку со вставками
+    for (size_t step = 0; step < 2 * entities.size(); ++step) {
+        int k = rand() % listNum;
+        if (handles[k].empty()) continue;
+        size_t i = rnd() % handles[k].size();
+        lists[k].erase(handles[k][i]);
+        handles[k][i] = handles[k].back();
+        handles[k].pop_back();
+        int k2 = rand() % listNum;
+        handles[k2].push_back(InsertOwner(lists[k2], entities[step % entities.size()]));
+    }
+    size_t num = 0, nodeNum = 0;
+    for (int k = 0; k < listNum; ++k) {
+        num += lists[k].size();
+        nodeNum += NodeCount(lists[k]);
+    }
+
+    uintptr_t sum = 0;
+    const int kRepeat = 50;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRepeat; ++r) {
+        for (int k = 0; k < listNum; ++k) {
+            for (typename L::iterator it = lists[k].begin(); it != lists[k].end(); ++it) sum += (uintptr_t)*it;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / kRepeat;
+    printf("%s: %.3f ms per walk, %.2f elements per node (checksum %u)\n", name, ms, double(num) / nodeNum, (uint)sum);
+    for (int k = 0; k < listNum; ++k) lists[k].clear();
+    return ms;
+}
+
+int main() {
+    struct Entity { int id_; };
+    typedef Entity* PEntity;
+    const int kEntityNum = 1000000, kListNum = 8;
+    std::vector<PEntity> entities(kEntityNum);
+    for (int i = 0; i < kEntityNum; ++i) entities[i] = (PEntity)(uintptr_t)(i * 64);
+    {
+        typedef yadsl::List<PEntity, yadsl::kPOD_LIST> OwnerList;
+        OwnerList::Pool pool(4096);
+        std::vector<OwnerList> lists;
+        for (int k = 0; k < kListNum; ++k) lists.emplace_back(pool);
+        BenchOwnerWalk<OwnerList, OwnerList::Node*>("List", &lists[0], kListNum, entities);
+    }
+    {
+        typedef yadsl::UnrolledList<PEntity, yadsl::kPOD_LIST> OwnerList;
+        printf("UnrolledList: %u elements in %u-byte node\n", (uint)OwnerList::kNodeCapacity, (uint)OwnerList::kNodeBytes);
+        OwnerList::Pool pool(512);
+        std::vector<OwnerList> lists;
+        for (int k = 0; k < kListNum; ++k) lists.emplace_back(pool);
+        BenchOwnerWalk<OwnerList, OwnerList::Handle>("UnrolledList", &lists[0], kListNum, entities);
+    }
+}
+#endif
+
+#endif // YADSL_UNROLLEDLIST_H
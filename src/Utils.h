@@ -3,6 +3,15 @@
 
 #include <vector>
 #include <algorithm>
+#include <stdlib.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#include <malloc.h> // _aligned_malloc()
+#endif
+
+#include "BaseTypes.h"
 
 #define YADSL_UNUSED_FUNC_PARAM(x) (void)(x)
 #define YADSL_RELEASE_COM(x) if ((x) != 0) { (x)->Release(); (x) = 0; }
@@ -16,6 +25,79 @@ inline void Swap(T& a, T& b) {
 	b = tmp;
 }
 
+//B I T S /////////////////////////////////////////////////////
+
+/** @brief Число младших нулевых бит 64-битного слова (индекс младшего установленного бита).
+    @note слово не должно быть нулевым.
+*/
+inline uint Ctz64(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return index;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/** @brief Число старших нулевых бит 64-битного слова (63 - индекс старшего установленного бита).
+    @note слово не должно быть нулевым.
+*/
+inline uint Clz64(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - index;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+/// Число установленных бит 64-битного слова
+inline uint Popcount64(uint64_t x) {
+#ifdef _MSC_VER
+    return (uint)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+//M E M O R Y /////////////////////////////////////////////////
+
+/// Округлить n вверх до кратного alignment (степень двойки)
+inline size_t AlignUp(size_t n, size_t alignment) {
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+/// Ближайшая степень двойки, не меньшая n
+inline size_t RoundUpPow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+/** @brief Выделить из кучи участок памяти, выровненный по alignment (степень двойки).
+    @return указатель на участок или 0 при нехватке памяти. Освобождать через AlignedFree().
+*/
+inline void* AlignedAlloc(size_t size, size_t alignment) {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    return _aligned_malloc(size, alignment);
+#else
+    void* p = 0;
+    if (posix_memalign(&p, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) != 0) return 0;
+    return p;
+#endif
+}
+
+/// Вернуть в кучу участок памяти, выделенный AlignedAlloc()
+inline void AlignedFree(void* p) {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
 //A L G O R I T H M S /////////////////////////////////////////
 
 /** @brief Поиск ближайшего элемента в векторе stl.